@@ -0,0 +1,102 @@
+//------------------------------------------------
+// Copyright (c) 2022 stickLabs.io  All rights reserved.
+//------------------------------------------------
+//
+// Host stand-in for ST's rfal_nfc.h and the platform headers it pulls in on
+// the lock.  Only what stickLabs.c uses: the NFC-V poller calls, the device
+// structs, and the platform macros.  The RF side is simulated in stk_host.c.
+//
+
+#ifndef __RFAL_NFC_H__
+#define __RFAL_NFC_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+
+//------------------------------------------------
+//                  PLATFORM
+//------------------------------------------------
+#define ct_assert(e)      _Static_assert((e), #e)
+#define assert_param(e)   ((void)0)
+#define platformLog(...)  stk_hostLog(__VA_ARGS__)
+
+void stk_hostLog(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+
+
+//------------------------------------------------
+//                    RFAL
+//------------------------------------------------
+typedef uint16_t ReturnCode;
+#define ERR_NONE          (0)
+#define ERR_TIMEOUT       (4)   // No tag answered (or it was pulled)
+#define ERR_RF_COLLISION  (29)  // Unaddressed command, more than one tag answered
+
+#define RFAL_CRC_LEN                (2)
+#define RFAL_NFCV_UID_LEN           (8)
+#define RFAL_NFCV_REQ_FLAG_DEFAULT  (0x02U)
+
+typedef enum
+{
+    RFAL_COMPLIANCE_MODE_NFC = 0,
+    RFAL_COMPLIANCE_MODE_EMV,
+    RFAL_COMPLIANCE_MODE_ISO,
+} rfalComplianceMode;
+
+typedef enum
+{
+    RFAL_NFC_LISTEN_TYPE_NFCA  = 0,
+    RFAL_NFC_LISTEN_TYPE_NFCB  = 1,
+    RFAL_NFC_LISTEN_TYPE_NFCF  = 2,
+    RFAL_NFC_LISTEN_TYPE_NFCV  = 3,
+} rfalNfcDevType;
+
+typedef struct
+{
+    uint8_t RES_FLAG;
+    uint8_t DSFID;
+    uint8_t UID[RFAL_NFCV_UID_LEN];
+} rfalNfcvInventoryRes;
+
+typedef struct
+{
+    rfalNfcvInventoryRes InvRes;
+    bool                 isSleep;
+} rfalNfcvListenDevice;
+
+typedef struct
+{
+    rfalNfcDevType type;
+    union {
+        rfalNfcvListenDevice nfcv;
+    } dev;
+    uint8_t *nfcid;
+    uint8_t  nfcidLen;
+} rfalNfcDevice;
+
+// A non-NULL uid sends the command addressed to that tag only
+ReturnCode rfalNfcvPollerReadSingleBlock(uint8_t flags, const uint8_t *uid, uint8_t blockNum,
+                                         uint8_t *rxBuf, uint16_t rxBufLen, uint16_t *rcvLen);
+ReturnCode rfalNfcvPollerReadMultipleBlocks(uint8_t flags, const uint8_t *uid, uint8_t firstBlockNum,
+                                            uint8_t numOfBlocks, uint8_t *rxBuf, uint16_t rxBufLen,
+                                            uint16_t *rcvLen);
+ReturnCode rfalNfcvPollerExtendedReadMultipleBlocks(uint8_t flags, const uint8_t *uid, uint16_t firstBlockNum,
+                                                    uint16_t numOfBlocks, uint8_t *rxBuf, uint16_t rxBufLen,
+                                                    uint16_t *rcvLen);
+ReturnCode rfalNfcvPollerCollisionResolution(rfalComplianceMode compMode, uint8_t devLimit,
+                                             rfalNfcvListenDevice *nfcvDevList, uint8_t *devCnt);
+
+
+//------------------------------------------------
+//            APPLICATION (out of tree)
+//------------------------------------------------
+// Implemented next to the state machine on the lock, by stk_host.c here.
+// The stk_data argument is void * because its type lives in stickLabs.c.
+bool     isTheSame(rfalNfcDevice *nfcDev, bool truST25, int idx, int i);
+uint64_t stk_nfcDev_or_backupStk(rfalNfcDevice *nfcDev, void *dat);
+void     stk_writeToRamFlash_uid(uint64_t uid, bool truST25, bool isMaster, int idx, int i);
+void     stk_writeToRamFlash_ent(void *ent, int idx, int i);
+
+#endif // __RFAL_NFC_H__
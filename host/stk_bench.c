@@ -0,0 +1,1431 @@
+//------------------------------------------------
+// Copyright (c) 2022 stickLabs.io  All rights reserved.
+//------------------------------------------------
+//
+// Host checks and benchmarks for stickLabs.c, on the simulated platform in
+// stk_host.c.
+//
+//     stk_bench                 full run
+//     stk_bench --check         short run; exit status 1 if a check failed
+//     ... --export FILE         also write the STKFUNC_GET_DEBUG_INFO blob
+//     ... --log FILE            also write an STKFUNC_GET_ACCESS_LOGS read-out
+//     ... -v                    platformLog() to stderr
+//
+// One JSON object per line on stdout, names are stable across versions so
+// runs can be diffed:
+//
+//     {"bench":"<name>","n":<ops>,"ns":<per op>,"host_cycles_32mhz":<per op>}
+//     {"metric":"<name>","value":<value>,"unit":"<unit>"}
+//
+// "host_cycles_32mhz" is host time expressed in cycles of the 32 MHz target
+// clock (STK_HOST_MHZ), the scale stk_cycleCount() and the debug info
+// histograms use on the host.  It is not a cycle count of the lock: host
+// times only compare host runs.  RF commands and EEPROM writes are exact,
+// RF air time is modelled (stk_hostRfFrameUs()).
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// One translation unit with the firmware: most of the DB code is static
+#include "../stickLabs.c"
+#include "stk_host.h"
+
+ct_assert(STK_HOST_MHZ == 32); // The JSON field name
+ct_assert(STK_HOST_META1_ISTRUST25 == STK_ENTRY_META1_ISTRUST25);
+ct_assert(STK_HOST_META1_ISMASTER == STK_ENTRY_META1_ISMASTER);
+ct_assert(STK_HOST_FUNC_BACKUP == STKFUNC_BACKUP_STICKER);
+ct_assert(STK_HOST_BACKUP_UID_OFS == offsetof(stk_data, payload.fmat.UID));
+ct_assert(STK_HOST_LOG_SECTOR == STK_LOG_SECTOR_LEN);
+ct_assert((STK_LOG_NUM_SECTORS * STK_LOG_SECTOR_LEN) <= STK_HOST_LOG_BYTES);
+ct_assert((1 + (STK_ONFLASH_NUM_MEMBERS * STK_WORDS_PER_MEMBER)) <= STK_HOST_EEPROM_WORDS);
+ct_assert((STK_CP_OFD_START_BLOCK + (STK_ONFLASH_DATA_LEN / NFCV_BLOCK_LEN)) <= STK_HOST_TAG_BLOCKS);
+
+#define BENCH_FULL_IMAGE_WORDS  (STK_ONFLASH_NUM_MEMBERS * STK_WORDS_PER_MEMBER)
+
+static int      gFails;
+static uint32_t gIters = 200000;
+static uint64_t gRnd = 0x5EEDF00DULL;
+static volatile uint32_t gBenchSink; // Results benchmarks must not optimise away
+
+#define CHECK(e)                                                            \
+    do {                                                                    \
+        if (!(e)) {                                                         \
+            fprintf(stderr, "FAIL %s:%d: %s\n", __FILE__, __LINE__, #e);    \
+            gFails++;                                                       \
+        }                                                                   \
+    } while (0)
+
+
+//------------------------------------------------
+//                  HELPERS
+//------------------------------------------------
+static uint64_t benchRand(void)
+{
+    gRnd ^= gRnd << 13;
+    gRnd ^= gRnd >> 7;
+    gRnd ^= gRnd << 17;
+    return gRnd;
+}
+
+// A random ST ISO15693 UID (E0 02 ...), as stk_nfcDev_or_backupStk() returns it
+static uint64_t benchUid(void)
+{
+    return 0xE002000000000000ULL | (benchRand() & 0x0000FFFFFFFFFFFFULL);
+}
+
+static void benchReport(const char *name, uint32_t n, uint64_t ns)
+{
+    double lns = (double)ns / (double)n;
+    printf("{\"bench\":\"%s\",\"n\":%u,\"ns\":%.1f,\"host_cycles_32mhz\":%.0f}\n",
+           name, n, lns, (lns * STK_HOST_MHZ) / 1000.0);
+}
+
+static void benchMetric(const char *name, double value, const char *unit)
+{
+    printf("{\"metric\":\"%s\",\"value\":%g,\"unit\":\"%s\"}\n", name, value, unit);
+}
+
+// Power-on: empty field, blank EEPROM and log, empty DB
+static void benchReset(void)
+{
+    stk_hostReset();
+    gStkHostRtc = 1000000; // Time-based caches must not see their zeroed entries as fresh
+
+    memset((uint8_t *)&gStkRamFlash, 0, sizeof(gStkRamFlash));
+    memset((uint8_t *)gStkDirty, 0, sizeof(gStkDirty));
+    memset((uint8_t *)&gStkSpan, 0, sizeof(gStkSpan));
+    memset((uint8_t *)&gStkPaste, 0, sizeof(gStkPaste));
+    memset((uint8_t *)gStkTruST25Cache, 0, sizeof(gStkTruST25Cache));
+    memset((uint8_t *)&gStkPollHist, 0, sizeof(gStkPollHist));
+    memset((uint8_t *)gStkPollDecisions, 0, sizeof(gStkPollDecisions));
+    gStkPollLastTap  = 0;
+    gStkPollLastRead = 0;
+    gStkPollLastUid  = 0;
+    gStkReadHist     = 0;
+    gStkFieldCnt     = 0;
+    gStkTruST25Checks = 0;
+    gStkTruST25CacheHits = 0;
+
+    stk_dbIndexInit();
+}
+
+// Boot: load gStkRamFlash from the emulated EEPROM (done by the platform on
+// the lock)
+static void benchLoadRamFlash(void)
+{
+    int m = 0;
+    int k = 0;
+
+    for (m = 0; m < STK_ONFLASH_NUM_MEMBERS; m++) {
+        uint32_t lwords[STK_WORDS_PER_MEMBER];
+        for (k = 0; k < STK_WORDS_PER_MEMBER; k++) {
+            stk_eepromRead32((uint16_t)(1 + (m * STK_WORDS_PER_MEMBER) + k), &lwords[k]);
+        }
+        memcpy((uint8_t *)&gSRF[m], (uint8_t *)lwords, STK_DB_ENTRY_SIZE);
+    }
+    memset((uint8_t *)gStkDirty, 0, sizeof(gStkDirty));
+}
+
+// Enroll n random stickers, committed.  uids[] gets them (may be NULL).
+static void benchFill(int n, uint64_t *uids)
+{
+    int i = 0;
+
+    for (i = 0; i < n; i++) {
+        uint64_t luid = benchUid();
+        CHECK(stk_dbAddUid(luid, false, false));
+        if (uids != NULL) {
+            uids[i] = luid;
+        }
+    }
+    stk_commitRamFlash();
+}
+
+static bool benchIsInDB(uint64_t uid, bool truST25)
+{
+    rfalNfcDevice ldev;
+    uint8_t lnfcid[RFAL_NFCV_UID_LEN];
+
+    memcpy(lnfcid, (uint8_t *)&uid, RFAL_NFCV_UID_LEN);
+    memset((uint8_t *)&ldev, 0, sizeof(ldev));
+    ldev.type     = RFAL_NFC_LISTEN_TYPE_NFCV;
+    ldev.nfcid    = lnfcid;
+    ldev.nfcidLen = RFAL_NFCV_UID_LEN;
+    return stk_isInDB(&ldev, truST25);
+}
+
+// A function sticker with cp_dat and (for payload functions) cp_ofd data
+static stk_host_tag *benchSticker(uint64_t uid, stk_function function, const void *ofd, uint32_t len)
+{
+    stk_host_tag *ltag = stk_hostTagAdd(uid);
+    stk_data ldat;
+
+    memset((uint8_t *)&ldat, 0, sizeof(ldat));
+    ldat.always.version  = STK_ONSTICK_DATA_VERSION2;
+    ldat.always.function = function;
+    stk_hostTagWrite(ltag, STK_DATA_START_BLOCK, &ldat, sizeof(ldat));
+    if (ofd != NULL) {
+        stk_hostTagWrite(ltag, STK_CP_OFD_START_BLOCK, ofd, len);
+    }
+    return ltag;
+}
+
+// A config payload image of n random UIDs, sealed
+static uint16_t benchImage(stk_onflash_data *ofd, int n)
+{
+    int i = 0;
+
+    memset((uint8_t *)ofd, 0, sizeof(*ofd));
+    ofd->master1.uid = benchUid();
+    ofd->master1.meta1_truST25_mast = STK_ENTRY_META1_ISMASTER;
+    for (i = 0; i < n; i++) {
+        ofd->entries[i].uid = benchUid();
+    }
+    return stk_ofdSeal(ofd);
+}
+
+
+//------------------------------------------------
+//                 CRC (user-014)
+//------------------------------------------------
+// Bit-at-a-time CRC-16/MCRF4XX, the definition the table must match
+static uint16_t benchCrcBitwise(const uint8_t *buf, uint32_t len)
+{
+    uint16_t lcrc = 0xFFFFU;
+    int b = 0;
+
+    while (len--) {
+        lcrc ^= *buf++;
+        for (b = 0; b < 8; b++) {
+            lcrc = (lcrc & 1U) ? (uint16_t)((lcrc >> 1) ^ 0x8408U) : (uint16_t)(lcrc >> 1);
+        }
+    }
+    return lcrc;
+}
+
+static void benchCrc(void)
+{
+    static const uint8_t lcheck[] = "123456789";
+    uint8_t  limg[STK_ONFLASH_DATA_LEN];
+    uint16_t lsum = 0;
+    uint64_t t = 0;
+    uint32_t n = gIters / 100;
+    uint32_t i = 0;
+
+    for (i = 0; i < sizeof(limg); i++) {
+        limg[i] = (uint8_t)benchRand();
+    }
+
+    // Golden vectors: the CRC-16/MCRF4XX check value, empty input, and a
+    // full image against the bitwise definition
+    CHECK(stk_crc16Final(stk_crc16Update(stk_crc16Init(), lcheck, 9)) == 0x6F91U);
+    CHECK(stk_crc16Final(stk_crc16Update(stk_crc16Init(), lcheck, 0)) == 0xFFFFU);
+    CHECK(stk_crc16Update(stk_crc16Update(stk_crc16Init(), lcheck, 4), &lcheck[4], 5) == 0x6F91U);
+    CHECK(stk_crc16Update(stk_crc16Init(), limg, sizeof(limg)) == benchCrcBitwise(limg, sizeof(limg)));
+    CHECK(stk_crc16UpdateSlice8(stk_crc16Init(), lcheck, 9) == 0x6F91U);
+    CHECK(stk_crc16UpdateSlice8(stk_crc16Init(), limg, sizeof(limg)) == benchCrcBitwise(limg, sizeof(limg)));
+    benchMetric("crc16.check_123456789", stk_crc16Update(stk_crc16Init(), lcheck, 9), "value");
+
+    t = stk_hostNowNs();
+    for (i = 0; i < n; i++) {
+        limg[i % sizeof(limg)]++; // New input each time, or the loop is hoisted
+        lsum ^= benchCrcBitwise(limg, sizeof(limg));
+    }
+    benchReport("crc16.image.bitwise", n, stk_hostNowNs() - t);
+
+    t = stk_hostNowNs();
+    for (i = 0; i < n; i++) {
+        limg[i % sizeof(limg)]++; // New input each time, or the loop is hoisted
+        lsum ^= stk_crc16Update(stk_crc16Init(), limg, sizeof(limg));
+    }
+    benchReport("crc16.image.table", n, stk_hostNowNs() - t);
+
+    t = stk_hostNowNs();
+    for (i = 0; i < n; i++) {
+        limg[i % sizeof(limg)]++; // New input each time, or the loop is hoisted
+        lsum ^= stk_crc16UpdateSlice8(stk_crc16Init(), limg, sizeof(limg));
+    }
+    benchReport("crc16.image.slice8", n, stk_hostNowNs() - t);
+
+    gBenchSink = lsum;
+}
+
+
+//------------------------------------------------
+//       LOOKUPS (user-001, user-002, user-010)
+//------------------------------------------------
+// stk_isInDB() as it was before the index: isTheSame() on every non-zero slot
+static bool benchIsInDBBaseline(rfalNfcDevice *nfcDev, bool truST25)
+{
+    int i = 0;
+
+    for (i = 0; i < STK_ONFLASH_ENTRIES; i++) {
+        if ( (gStkRamFlash.entries[i].uid != 0) &&
+              isTheSame(nfcDev, truST25, IDX_uids, i) )
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void benchLookupFill(int fillPct)
+{
+    static uint64_t luids[STK_ONFLASH_ENTRIES];
+    char     lname[64];
+    int      lnum = (STK_ONFLASH_ENTRIES * fillPct) / 100;
+    uint32_t n = gIters;
+    uint32_t lhits = 0;
+    uint32_t lfp = 0;
+    uint32_t i = 0;
+    uint64_t t = 0;
+
+    benchReset();
+    benchFill(lnum, luids);
+    CHECK(stk_dbIndexVerify());
+    CHECK(gStkUidIdxCnt == lnum);
+
+    // Hits, tap cache flushed so every lookup goes through the index
+    if (lnum > 0) {
+        t = stk_hostNowNs();
+        for (i = 0; i < n; i++) {
+            stk_tapCacheFlush();
+            lhits += benchIsInDB(luids[i % lnum], false);
+        }
+        snprintf(lname, sizeof(lname), "isInDB.hit.fill%d", fillPct);
+        benchReport(lname, n, stk_hostNowNs() - t);
+        CHECK(lhits == n);
+    }
+
+    // Misses: stickers that are not enrolled
+    lhits = 0;
+    t = stk_hostNowNs();
+    for (i = 0; i < n; i++) {
+        stk_tapCacheFlush();
+        lhits += benchIsInDB(benchUid(), false);
+    }
+    snprintf(lname, sizeof(lname), "isInDB.miss.fill%d", fillPct);
+    benchReport(lname, n, stk_hostNowNs() - t);
+    CHECK(lhits == 0);
+
+    // Before the index (user-001)
+    {
+        rfalNfcDevice ldev;
+        uint8_t lnfcid[RFAL_NFCV_UID_LEN];
+
+        memset((uint8_t *)&ldev, 0, sizeof(ldev));
+        ldev.type     = RFAL_NFC_LISTEN_TYPE_NFCV;
+        ldev.nfcid    = lnfcid;
+        ldev.nfcidLen = RFAL_NFCV_UID_LEN;
+
+        if (lnum > 0) {
+            lhits = 0;
+            t = stk_hostNowNs();
+            for (i = 0; i < n / 10; i++) {
+                memcpy(lnfcid, (uint8_t *)&luids[i % lnum], RFAL_NFCV_UID_LEN);
+                lhits += benchIsInDBBaseline(&ldev, false);
+            }
+            snprintf(lname, sizeof(lname), "isInDB.hit.baseline.fill%d", fillPct);
+            benchReport(lname, n / 10, stk_hostNowNs() - t);
+            CHECK(lhits == (n / 10));
+        }
+
+        lhits = 0;
+        t = stk_hostNowNs();
+        for (i = 0; i < n / 10; i++) {
+            uint64_t luid = benchUid();
+            memcpy(lnfcid, (uint8_t *)&luid, RFAL_NFCV_UID_LEN);
+            lhits += benchIsInDBBaseline(&ldev, false);
+        }
+        snprintf(lname, sizeof(lname), "isInDB.miss.baseline.fill%d", fillPct);
+        benchReport(lname, n / 10, stk_hostNowNs() - t);
+        CHECK(lhits == 0);
+    }
+
+    // The linear fallback served while the index is built after boot
+    if (lnum > 0) {
+        gStkIdxReady = false;
+        lhits = 0;
+        t = stk_hostNowNs();
+        for (i = 0; i < n / 10; i++) {
+            stk_tapCacheFlush();
+            lhits += benchIsInDB(luids[i % lnum], false);
+        }
+        snprintf(lname, sizeof(lname), "isInDB.hit.linear.fill%d", fillPct);
+        benchReport(lname, n / 10, stk_hostNowNs() - t);
+        CHECK(lhits == (n / 10));
+        gStkIdxReady = true;
+    }
+
+    // Bloom filter false positives (user-002), measured on unknown UIDs
+    for (i = 0; i < n; i++) {
+        lfp += stk_bloomMayContain(benchUid());
+    }
+    snprintf(lname, sizeof(lname), "bloom.fp_rate.fill%d", fillPct);
+    benchMetric(lname, (100.0 * lfp) / n, "%");
+    if (fillPct == 100) {
+        CHECK(((100.0 * lfp) / n) < 1.5); // 0.55% documented at STK_BLOOM_BITS
+    }
+}
+
+// user-010: a full scan of the packed entries[] vs the aligned mirror
+static void benchScan(void)
+{
+    uint32_t n = gIters / 100;
+    uint32_t lfound = 0;
+    uint32_t i = 0;
+    int      s = 0;
+    uint64_t t = 0;
+
+    benchReset();
+    benchFill(STK_ONFLASH_ENTRIES, NULL);
+
+    t = stk_hostNowNs();
+    for (i = 0; i < n; i++) {
+        uint64_t luid = benchUid();
+        for (s = 0; s < STK_ONFLASH_ENTRIES; s++) {
+            lfound += (gStkRamFlash.entries[s].uid == luid);
+        }
+    }
+    benchReport("scan.aos_entries", n, stk_hostNowNs() - t);
+
+    t = stk_hostNowNs();
+    for (i = 0; i < n; i++) {
+        uint64_t luid = benchUid();
+        for (s = 0; s < STK_ONFLASH_ENTRIES; s++) {
+            lfound += (gStkDbUids[s] == luid);
+        }
+    }
+    benchReport("scan.soa_mirror", n, stk_hostNowNs() - t);
+
+    CHECK(lfound == 0);
+}
+
+
+//------------------------------------------------
+//      ADD/REMOVE CHURN (user-004, user-005)
+//------------------------------------------------
+// A backup sticker (own UID tagUid) for the user sticker userUid
+static void benchBackupData(stk_data *dat, uint64_t userUid, bool truST25)
+{
+    memset((uint8_t *)dat, 0, sizeof(*dat));
+    dat->always.version  = STK_ONSTICK_DATA_VERSION2;
+    dat->always.function = STKFUNC_BACKUP_STICKER;
+    memcpy(dat->payload.fmat.UID, (uint8_t *)&userUid, RFAL_NFCV_UID_LEN);
+    dat->payload.fmat.meta1_truST25 = truST25 ? 1 : 0;
+}
+
+// The master-session paths: stk_addSticker(), stk_removeSticker() and
+// stk_bkupIsInDB() with user and backup stickers
+static void benchStickers(void)
+{
+    stk_host_tag *ltag = NULL;
+    rfalNfcDevice ldev;
+    rfalNfcDevice luserDev;
+    stk_data ldat;
+    stk_data lregular;
+    uint64_t luserUid = benchUid();
+    uint32_t n = gIters / 10;
+    uint32_t lhits = 0;
+    uint32_t i = 0;
+    uint64_t t = 0;
+    int      lslot = 0;
+
+    benchReset();
+    benchFill(STK_ONFLASH_ENTRIES / 2, NULL);
+    stk_hostNfcDev(stk_hostTagAdd(luserUid), &luserDev);
+    memset((uint8_t *)&lregular, 0, sizeof(lregular));
+    lregular.always.version  = STK_ONSTICK_DATA_VERSION2;
+    lregular.always.function = STKFUNC_REGULAR;
+
+    // Enrolling by backup sticker: the user sticker's UID goes in, with
+    // TruST25 if the backup's meta says so
+    ltag = stk_hostTagAdd(benchUid());
+    stk_hostNfcDev(ltag, &ldev);
+    benchBackupData(&ldat, luserUid, true);
+    CHECK(stk_addSticker(&ldev, false, &ldat));
+    CHECK(stk_bkupIsInDB(&ldev, &ldat));
+    CHECK(!stk_bkupIsInDB(&ldev, &lregular)); // The backup's own UID is not enrolled
+    lslot = stk_idxFind(luserUid);
+    CHECK(lslot >= 0);
+    CHECK((lslot >= 0) && (gStkDbMeta[lslot] & STK_ENTRY_META1_ISTRUST25));
+    gStkHostRf.truST25 = 0;
+    CHECK(stk_isInDB(&luserDev, true));
+    CHECK(gStkHostRf.truST25 == 1);
+
+    // Again: already in, no second slot
+    CHECK(stk_addSticker(&ldev, false, &ldat));
+    CHECK(stk_dbIndexVerify());
+
+    // Removing by backup sticker takes the user sticker out
+    CHECK(stk_removeSticker(&ldev, &ldat));
+    CHECK(!stk_bkupIsInDB(&ldev, &ldat));
+    CHECK(!stk_isInDB(&luserDev, true));
+
+    // The sticker itself: its own UID, TruST25 as the caller says
+    CHECK(stk_addSticker(&luserDev, false, &lregular));
+    lslot = stk_idxFind(luserUid);
+    CHECK((lslot >= 0) && !(gStkDbMeta[lslot] & STK_ENTRY_META1_ISTRUST25));
+    CHECK(stk_removeSticker(&luserDev, &lregular));
+    CHECK(stk_idxFind(luserUid) < 0);
+    CHECK(gStkUidIdxCnt == (STK_ONFLASH_ENTRIES / 2));
+
+    t = stk_hostNowNs();
+    for (i = 0; i < n; i++) {
+        benchBackupData(&ldat, benchUid(), (i & 1) != 0);
+        stk_addSticker(&ldev, false, &ldat);
+        lhits += stk_bkupIsInDB(&ldev, &ldat);
+        stk_removeSticker(&ldev, &ldat);
+    }
+    benchReport("stickerAddRemove.backup.fill50", n, stk_hostNowNs() - t);
+    CHECK(lhits == n);
+    CHECK(stk_dbIndexVerify());
+    CHECK(gStkUidIdxCnt == (STK_ONFLASH_ENTRIES / 2));
+
+    lhits = 0;
+    t = stk_hostNowNs();
+    for (i = 0; i < n; i++) {
+        benchBackupData(&ldat, benchUid(), false);
+        lhits += stk_bkupIsInDB(&ldev, &ldat);
+    }
+    benchReport("bkupIsInDB.miss.fill50", n, stk_hostNowNs() - t);
+    CHECK(lhits == 0);
+}
+
+static void benchChurn(void)
+{
+    uint64_t luids[10];
+    uint32_t n = gIters / 10;
+    uint32_t i = 0;
+    uint64_t t = 0;
+
+    benchReset();
+    benchFill(STK_ONFLASH_ENTRIES / 2, NULL);
+
+    t = stk_hostNowNs();
+    for (i = 0; i < n; i++) {
+        uint64_t luid = benchUid();
+        stk_dbAddUid(luid, false, false);
+        stk_dbRemoveUid(luid);
+    }
+    benchReport("dbAddRemove.fill50", n, stk_hostNowNs() - t);
+    CHECK(stk_dbIndexVerify());
+    CHECK(gStkUidIdxCnt == (STK_ONFLASH_ENTRIES / 2));
+
+    // A master session enrolling 10 stickers: only their members are written
+    stk_commitRamFlash();
+    gStkHostEepromWrites = 0;
+    for (i = 0; i < 10; i++) {
+        luids[i] = benchUid();
+        stk_dbAddUid(luids[i], false, false);
+    }
+    CHECK(stk_commitRamFlash());
+    benchMetric("eeprom.words.enroll10", gStkHostEepromWrites, "words");
+    benchMetric("eeprom.words.full_image", BENCH_FULL_IMAGE_WORDS, "words");
+    CHECK(gStkHostEepromWrites == (10 * STK_WORDS_PER_MEMBER));
+
+    gStkHostEepromWrites = 0;
+    for (i = 0; i < 10; i++) {
+        stk_dbRemoveUid(luids[i]);
+    }
+    CHECK(stk_commitRamFlash());
+    benchMetric("eeprom.words.remove10", gStkHostEepromWrites, "words");
+    CHECK(gStkHostEepromWrites == (10 * STK_WORDS_PER_MEMBER));
+
+    // Nothing dirty, nothing written
+    gStkHostEepromWrites = 0;
+    CHECK(stk_commitRamFlash());
+    CHECK(gStkHostEepromWrites == 0);
+
+    // The write-back is what the next boot loads
+    benchLoadRamFlash();
+    stk_dbIndexInit();
+    CHECK(gStkUidIdxCnt == (STK_ONFLASH_ENTRIES / 2));
+    CHECK(!benchIsInDB(luids[0], false));
+}
+
+
+//------------------------------------------------
+//  CONFIG PAYLOADS (user-006, 007, 012, 013, 023)
+//------------------------------------------------
+static stk_onflash_data gBenchOfd;
+
+static void benchPaste(void)
+{
+    rfalNfcDevice ldev;
+    uint16_t lnumBlks = benchImage(&gBenchOfd, 300);
+    uint32_t lperBlock = (lnumBlks * STK_DB_ENTRY_SIZE) / NFCV_BLOCK_LEN;
+    uint32_t n = gIters / 2000;
+    uint32_t i = 0;
+    uint64_t t = 0;
+
+    if (n == 0) {
+        n = 1;
+    }
+
+    benchReset();
+    stk_hostNfcDev(benchSticker(0xE002000000000101ULL, STKFUNC_CONFIG_PAYLOAD, &gBenchOfd, sizeof(gBenchOfd)),
+                   &ldev);
+
+    // Into an empty lock: every page is read
+    CHECK(stk_readConfigPayload(&ldev));
+    benchMetric("paste.rf_cmds", gStkHostRf.cmds, "cmds");
+    benchMetric("paste.blocks", gStkHostRf.blocks, "blocks");
+    benchMetric("paste.per_block_cmds", lperBlock, "cmds"); // Read Single Block per block
+    CHECK(gStkHostRf.cmds < (lperBlock / 16));
+
+    // Air time (user-007): the same blocks one addressed Read Single Block
+    // each (flags, command, UID, block, CRC; flags, block, CRC back)
+    {
+        uint32_t lperBlockUs = lperBlock * stk_hostRfFrameUs(2 + RFAL_NFCV_UID_LEN + 1 + RFAL_CRC_LEN,
+                                                             1 + NFCV_BLOCK_LEN + RFAL_CRC_LEN);
+        benchMetric("paste.air_ms", gStkHostRf.airUs / 1000.0, "ms");
+        benchMetric("paste.per_block_air_ms", lperBlockUs / 1000.0, "ms");
+        CHECK((gStkHostRf.airUs * 4) < lperBlockUs);
+    }
+    CHECK(memcmp((uint8_t *)gStkRamFlash.entries, (uint8_t *)gBenchOfd.entries, sizeof(gBenchOfd.entries)) == 0);
+    CHECK(stk_dbIndexVerify());
+    CHECK(gStkUidIdxCnt == 300);
+    benchMetric("paste.eeprom_words", gStkHostEepromWrites, "words");
+    CHECK(gStkHostEepromWrites <= (lnumBlks * STK_WORDS_PER_MEMBER));
+
+    // Again into a lock that already has it (user-013): unchanged pages are
+    // not read
+    memset((uint8_t *)&gStkHostRf, 0, sizeof(gStkHostRf));
+    CHECK(stk_readConfigPayload(&ldev));
+    benchMetric("paste.resync.blocks", gStkHostRf.blocks, "blocks");
+    benchMetric("paste.resync.air_ms", gStkHostRf.airUs / 1000.0, "ms");
+    CHECK(gStkHostRf.blocks < (lperBlock / 4));
+
+    // A stale digest on the source still pastes, with one full re-read
+    gBenchOfd.entries[40].uid = benchUid();
+    gBenchOfd.op_mode.crc = stk_ofdCrc(&gBenchOfd, lnumBlks);
+    stk_hostTagWrite(&gStkHostTag[0], STK_CP_OFD_START_BLOCK, &gBenchOfd, sizeof(gBenchOfd));
+    memset((uint8_t *)&gStkHostRf, 0, sizeof(gStkHostRf));
+    CHECK(stk_readConfigPayload(&ldev));
+    benchMetric("paste.stale_digest.blocks", gStkHostRf.blocks, "blocks");
+    CHECK(gStkRamFlash.entries[40].uid == gBenchOfd.entries[40].uid);
+
+    // A different image, pulled part way: nothing changes
+    benchImage(&gBenchOfd, 300);
+    stk_hostTagWrite(&gStkHostTag[0], STK_CP_OFD_START_BLOCK, &gBenchOfd, sizeof(gBenchOfd));
+    {
+        uint16_t lcrc = stk_dbCrc();
+        gStkHostTag[0].pullAfter = 5;
+        CHECK(!stk_readConfigPayload(&ldev));
+        CHECK(stk_dbCrc() == lcrc);
+        CHECK(!stk_isDirty());
+        CHECK(stk_dbIndexVerify());
+        gStkHostTag[0].pullAfter = -1;
+    }
+
+    // Unreadable EEPROM (user-006): a revert leaves the member dirty rather
+    // than emptying it, and a paste does not start over changes it could
+    // not commit
+    {
+        int      lm = IDX_uids + 7;
+        uint64_t lold = gSRF[lm].uid;
+        uint64_t lnew = benchUid();
+
+        gSRF[lm].uid = lnew;
+        stk_markDirty(IDX_op_mode, lm);
+        gStkHostEepromBad = 1 + (lm * STK_WORDS_PER_MEMBER);
+        CHECK(!stk_revertRamFlash());
+        CHECK(stk_memberIsDirty(lm));
+        CHECK(gSRF[lm].uid == lnew);
+
+        memset((uint8_t *)&gStkHostRf, 0, sizeof(gStkHostRf));
+        CHECK(!stk_readConfigPayload(&ldev));
+        CHECK(gStkHostRf.cmds == 0);
+        CHECK(stk_memberIsDirty(lm));
+        CHECK(gSRF[lm].uid == lnew);
+
+        gStkHostEepromBad = 0;
+        CHECK(stk_revertRamFlash());
+        CHECK(!stk_isDirty());
+        CHECK(gSRF[lm].uid == lold);
+        stk_dbIndexInit();
+    }
+
+    t = stk_hostNowNs();
+    for (i = 0; i < n; i++) {
+        benchReset();
+        stk_hostNfcDev(benchSticker(0xE002000000000101ULL, STKFUNC_CONFIG_PAYLOAD, &gBenchOfd,
+                                    sizeof(gBenchOfd)), &ldev);
+        stk_readConfigPayload(&ldev);
+    }
+    benchReport("paste.300", n, stk_hostNowNs() - t);
+
+    t = stk_hostNowNs();
+    for (i = 0; i < (n * 10); i++) {
+        stk_ofdSeal(&gBenchOfd);
+    }
+    benchReport("ofdSeal", n * 10, stk_hostNowNs() - t);
+}
+
+static void benchDelta(void)
+{
+    uint8_t  lbuf[3 * STK_DB_ENTRY_SIZE];
+    stk_delta_hdr lhdr;
+    stk_delta_op  lops[2];
+    uint64_t luids[200];
+    uint64_t lnew = benchUid();
+    rfalNfcDevice ldev;
+
+    benchReset();
+    benchFill(200, luids);
+
+    memset((uint8_t *)lops, 0, sizeof(lops));
+    lops[0].op  = STK_DELTA_OP_REMOVE;
+    lops[0].uid = luids[17];
+    lops[1].op  = STK_DELTA_OP_ADD;
+    lops[1].uid = lnew;
+    lops[1].meta1_truST25_mast = STK_ENTRY_META1_ISTRUST25;
+
+    memset((uint8_t *)&lhdr, 0, sizeof(lhdr));
+    lhdr.version = STK_DELTA_VERSION;
+    lhdr.numOps  = 2;
+    lhdr.baseCrc = stk_dbCrc();
+    lhdr.crc     = stk_crc16Final(stk_crc16Update(stk_crc16Init(), (uint8_t *)lops, sizeof(lops)));
+    memcpy(lbuf, (uint8_t *)&lhdr, sizeof(lhdr));
+    memcpy(&lbuf[sizeof(lhdr)], (uint8_t *)lops, sizeof(lops));
+    stk_hostNfcDev(benchSticker(0xE002000000000102ULL, STKFUNC_CONFIG_DELTA_PAYLOAD, lbuf, sizeof(lbuf)),
+                   &ldev);
+
+    // Not over changes that could not be committed (user-006); reserved1 is
+    // not in stk_dbCrc(), so the base still matches
+    gSRF[IDX_reserved1].uid ^= 1;
+    stk_markDirty(IDX_op_mode, IDX_reserved1);
+    gStkHostEepromBad = 1 + (IDX_reserved1 * STK_WORDS_PER_MEMBER);
+    CHECK(!stk_readDeltaPayload(&ldev));
+    CHECK(benchIsInDB(luids[17], false));
+    CHECK(!benchIsInDB(lnew, false));
+    CHECK(stk_memberIsDirty(IDX_reserved1));
+    gStkHostEepromBad = 0;
+    CHECK(stk_commitRamFlash());
+
+    gStkHostEepromWrites = 0;
+    CHECK(stk_readDeltaPayload(&ldev));
+    benchMetric("delta.rf_cmds", gStkHostRf.cmds, "cmds");
+    benchMetric("delta.eeprom_words", gStkHostEepromWrites, "words");
+    CHECK(!benchIsInDB(luids[17], false));
+    CHECK(benchIsInDB(lnew, false));
+    CHECK(stk_dbIndexVerify());
+
+    // Same sticker again: its base no longer matches
+    CHECK(!stk_readDeltaPayload(&ldev));
+}
+
+// The chunk's sticker, alone in the field; dev gets its rfalNfcDevice
+static void benchSpanChunk(rfalNfcDevice *dev, uint8_t seq, uint8_t total, uint16_t first, uint16_t num, uint16_t dbCrc)
+{
+    static uint8_t lbuf[STK_DB_ENTRY_SIZE + STK_ONFLASH_DATA_LEN];
+    stk_span_hdr lhdr;
+
+    memset((uint8_t *)&lhdr, 0, sizeof(lhdr));
+    lhdr.version     = STK_SPAN_VERSION;
+    lhdr.seq         = seq;
+    lhdr.total       = total;
+    lhdr.dbCrc       = dbCrc;
+    lhdr.firstMember = first;
+    lhdr.numMembers  = num;
+    lhdr.crc = stk_crc16Final(stk_crc16Update(stk_crc16Init(),
+                                              (uint8_t *)&((stk_dbEntry *)&gBenchOfd)[first],
+                                              num * STK_DB_ENTRY_SIZE));
+    memcpy(lbuf, (uint8_t *)&lhdr, sizeof(lhdr));
+    memcpy(&lbuf[sizeof(lhdr)], (uint8_t *)&((stk_dbEntry *)&gBenchOfd)[first], num * STK_DB_ENTRY_SIZE);
+
+    stk_hostFieldClear();
+    stk_hostNfcDev(benchSticker(0xE002000000000103ULL + seq, STKFUNC_CONFIG_SPAN_PAYLOAD, lbuf,
+                                sizeof(lhdr) + (num * STK_DB_ENTRY_SIZE)), dev);
+}
+
+static void benchSpan(void)
+{
+    uint64_t luids[100];
+    uint16_t lwant = 0;
+    uint8_t  lremaining = 0;
+    uint16_t lbefore = 0;
+    rfalNfcDevice ldev;
+
+    // The DB the span carries, and its stk_dbCrc()
+    benchReset();
+    benchImage(&gBenchOfd, 250);
+    memcpy((uint8_t *)&gSRF[IDX_master1], (uint8_t *)&gBenchOfd.master1, STK_DB_ENTRY_SIZE);
+    memcpy((uint8_t *)gStkRamFlash.entries, (uint8_t *)gBenchOfd.entries, sizeof(gBenchOfd.entries));
+    lwant = stk_dbCrc();
+
+    benchReset();
+    benchFill(100, luids);
+    lbefore = stk_dbCrc();
+
+    benchSpanChunk(&ldev, 0, 2, 1, 149, lwant);
+    CHECK(stk_readSpanPayload(&ldev, &lremaining));
+    CHECK(lremaining == 1);
+
+    // Open span (user-023): nothing commits it, and taps are still checked
+    // against the committed DB, also for slots the chunk has overwritten
+    gStkHostEepromWrites = 0;
+    CHECK(stk_spanIsOpen());
+    CHECK(gSRF[IDX_uids + 50].uid == gBenchOfd.entries[50].uid);
+    CHECK(!stk_commitRamFlash());
+    CHECK(!stk_dbAddUid(benchUid(), false, false));
+    CHECK(benchIsInDB(luids[0], false));
+    CHECK(benchIsInDB(luids[50], false));
+    CHECK(!benchIsInDB(gBenchOfd.entries[50].uid, false));
+    CHECK(gSRF[IDX_uids + 50].uid == gBenchOfd.entries[50].uid);
+    CHECK(stk_dbIndexVerify());
+    CHECK(gStkHostEepromWrites == 0);
+
+    // A master session timing out in between does not matter
+    gStkHostRtc += STK_SPAN_TIMEOUT_SEC / 2;
+    benchSpanChunk(&ldev, 1, 2, 150, 108, lwant);
+    CHECK(stk_readSpanPayload(&ldev, &lremaining));
+    CHECK(lremaining == 0);
+    CHECK(!stk_spanIsOpen());
+    CHECK(stk_dbCrc() == lwant);
+    CHECK(!stk_isDirty());
+    CHECK(stk_dbIndexVerify());
+    CHECK(gStkUidIdxCnt == 250);
+    CHECK(benchIsInDB(gBenchOfd.entries[50].uid, false));
+    CHECK(!benchIsInDB(luids[50], false));
+
+    // Abandoned span: the DB goes back
+    benchReset();
+    benchFill(100, luids);
+    lbefore = stk_dbCrc();
+    benchSpanChunk(&ldev, 0, 2, 1, 149, lwant);
+    CHECK(stk_readSpanPayload(&ldev, &lremaining));
+    stk_spanAbort();
+    CHECK(stk_dbCrc() == lbefore);
+    CHECK(benchIsInDB(luids[0], false));
+
+    // Forgotten span: dropped after STK_SPAN_TIMEOUT_SEC without a chunk
+    CHECK(stk_readSpanPayload(&ldev, &lremaining));
+    CHECK(stk_spanIsOpen());
+    gStkHostRtc += STK_SPAN_TIMEOUT_SEC + 1;
+    CHECK(!stk_spanIsOpen());
+    CHECK(stk_dbCrc() == lbefore);
+    CHECK(!stk_isDirty());
+    CHECK(stk_dbAddUid(benchUid(), false, false));
+}
+
+
+//------------------------------------------------
+//   STICKER READS (user-016, user-017, user-019)
+//------------------------------------------------
+static void benchTruST25(void)
+{
+    stk_host_tag *ltag = NULL;
+    rfalNfcDevice ldev;
+    uint64_t luid = benchUid();
+    int i = 0;
+    int lallowed = 0;
+
+    benchReset();
+    CHECK(stk_dbAddUid(luid, true, false));
+    ltag = stk_hostTagAdd(luid);
+    stk_hostNfcDev(ltag, &ldev);
+
+    // 20 taps a few seconds apart (past the tap cache), within the TTL
+    for (i = 0; i < 20; i++) {
+        gStkHostRtc += 5;
+        lallowed += stk_isInDB(&ldev, true);
+    }
+    benchMetric("truST25.rf_checks.20_taps", gStkHostRf.truST25, "checks");
+    CHECK(lallowed == 20);
+    CHECK(gStkHostRf.truST25 == 2); // First tap, and once more after STK_TRUST25_CACHE_TTL_SEC
+
+    // A different sticker with the same UID is still checked after the TTL
+    gStkHostRtc += STK_TRUST25_CACHE_TTL_SEC + 1;
+    stk_tapCacheFlush();
+    gStkHostRf.truST25 = 0;
+    CHECK(stk_isInDB(&ldev, true));
+    CHECK(gStkHostRf.truST25 == 1);
+}
+
+static void benchReads(void)
+{
+    stk_host_tag *ltag = NULL;
+    rfalNfcDevice ldev;
+    stk_data ldat;
+    uint8_t  lbackup[STK_BACKUP_LENV2];
+    uint32_t lcmds = 0;
+    int i = 0;
+
+    benchReset();
+
+    // Regular sticker: one Read Single Block
+    ltag = benchSticker(benchUid(), STKFUNC_REGULAR, NULL, 0);
+    stk_hostNfcDev(ltag, &ldev);
+    CHECK(stk_readStickerData(&ldev, &ldat));
+    CHECK(ldat.always.function == STKFUNC_REGULAR);
+    benchMetric("read.rf_cmds.regular", gStkHostRf.cmds, "cmds");
+    CHECK(gStkHostRf.cmds == 1);
+
+    // A run of backup stickers (admin session, user-017): speculation
+    // brings them down to one command per tap
+    stk_hostFieldClear();
+    memset(lbackup, 0, sizeof(lbackup));
+    lbackup[0] = STK_ONSTICK_DATA_VERSION2;
+    lbackup[1] = STKFUNC_BACKUP_STICKER;
+    for (i = 0; i < 8; i++) {
+        stk_hostFieldClear();
+        ltag = stk_hostTagAdd(benchUid());
+        stk_hostTagWrite(ltag, STK_DATA_START_BLOCK, lbackup, sizeof(lbackup));
+        stk_hostNfcDev(ltag, &ldev);
+        lcmds = gStkHostRf.cmds;
+        gStkHostRtc += 10;
+        CHECK(stk_readStickerData(&ldev, &ldat));
+    }
+    benchMetric("read.rf_cmds.backup_run", gStkHostRf.cmds - lcmds, "cmds");
+    CHECK((gStkHostRf.cmds - lcmds) == 1);
+}
+
+static void benchField(void)
+{
+    stk_host_tag *lphone = NULL;
+    stk_host_tag *lmaster = NULL;
+    stk_host_tag *luser = NULL;
+    stk_host_tag *lcard = NULL;
+    uint8_t  ljunk[STK_DAT_ALWAYS_LEN] = { 0x33, 0xC7, 0x10, 0x02 };
+    uint64_t luserUid = benchUid();
+    stk_data ldat;
+    bool lallowed = false;
+    int  lpick = 0;
+
+    benchReset();
+    CHECK(stk_dbAddUid(luserUid, false, false));
+
+    // Phone (answers the inventory, not the reads) + master sticker: the
+    // master is handled, and its follow-up read only goes to it
+    lphone  = stk_hostTagAdd(benchUid());
+    lphone->mute = true;
+    lmaster = benchSticker(benchUid(), STKFUNC_MASTER, NULL, 0);
+    CHECK(stk_fieldInventory() == 2);
+    lpick = stk_fieldPick(false, &lallowed);
+    CHECK(lpick == 1);
+    CHECK(!lallowed);
+    CHECK(stk_readStickerData(&gStkField[lpick].dev, &ldat));
+    CHECK(ldat.always.function == STKFUNC_MASTER);
+    CHECK(gStkHostRf.collisions == 0);
+    benchMetric("field.rf_cmds.phone_master", gStkHostRf.cmds, "cmds");
+    CHECK(gStkHostRf.cmds == 3); // Inventory and two always reads, the master's is reused
+
+    // Transit card + enrolled sticker: the sticker is allowed
+    stk_hostFieldClear();
+    memset((uint8_t *)&gStkHostRf, 0, sizeof(gStkHostRf));
+    lcard = stk_hostTagAdd(benchUid());
+    stk_hostTagWrite(lcard, STK_DATA_START_BLOCK, ljunk, sizeof(ljunk));
+    luser = benchSticker(luserUid, STKFUNC_REGULAR, NULL, 0);
+    CHECK(stk_fieldInventory() == 2);
+    lpick = stk_fieldPick(false, &lallowed);
+    CHECK(lpick == 1);
+    CHECK(lallowed);
+    benchMetric("field.rf_cmds.card_user", gStkHostRf.cmds, "cmds");
+
+    // Unaddressed, the same read would have collided
+    {
+        rfalNfcDevice lanon = gStkField[lpick].dev;
+        lanon.nfcid    = NULL;
+        lanon.nfcidLen = 0;
+        CHECK(!stk_readStickerData(&lanon, &ldat));
+        CHECK(gStkHostRf.collisions != 0);
+    }
+
+    (void)lmaster;
+    (void)luser;
+}
+
+static uint32_t gBenchDetectUs; // Modelled detect to decision air time, one tag
+
+//
+// Detect to decision: from the poll seeing a field to knowing whether to
+// unlock, for an enrolled sticker alone and with one or two foreign tags
+// (phone, transit card) ahead of it in the inventory.  Air time is the
+// stk_hostRfFrameUs() model, host time only compares host runs.
+//
+static void benchDetect(void)
+{
+    uint8_t  ljunk[STK_DAT_ALWAYS_LEN] = { 0x33, 0xC7, 0x10, 0x02 };
+    uint64_t luserUid = benchUid();
+    uint32_t n = gIters / 100;
+    uint32_t i = 0;
+    uint64_t t = 0;
+    bool lallowed = false;
+    int  ltags = 0;
+    char lname[48];
+
+    if (n == 0) {
+        n = 1;
+    }
+
+    for (ltags = 1; ltags <= 3; ltags++) {
+        benchReset();
+        CHECK(stk_dbAddUid(luserUid, false, false));
+        if (ltags >= 2) {
+            stk_hostTagAdd(benchUid())->mute = true;
+        }
+        if (ltags >= 3) {
+            stk_hostTagWrite(stk_hostTagAdd(benchUid()), STK_DATA_START_BLOCK, ljunk, sizeof(ljunk));
+        }
+        benchSticker(luserUid, STKFUNC_REGULAR, NULL, 0);
+
+        CHECK(stk_fieldInventory() == ltags);
+        CHECK(stk_fieldPick(false, &lallowed) == (ltags - 1));
+        CHECK(lallowed);
+        CHECK(gStkHostRf.collisions == 0);
+        snprintf(lname, sizeof(lname), "field.detect_to_decision.tags%d.air_us", ltags);
+        benchMetric(lname, gStkHostRf.airUs, "us");
+        if (ltags == 1) {
+            gBenchDetectUs = gStkHostRf.airUs;
+        }
+        snprintf(lname, sizeof(lname), "field.detect_to_decision.tags%d.rf_cmds", ltags);
+        benchMetric(lname, gStkHostRf.cmds, "cmds");
+
+        t = stk_hostNowNs();
+        for (i = 0; i < n; i++) {
+            stk_tapCacheFlush();
+            stk_fieldInventory();
+            gBenchSink += (uint32_t)stk_fieldPick(false, &lallowed);
+        }
+        snprintf(lname, sizeof(lname), "field.detect_to_decision.tags%d", ltags);
+        benchReport(lname, n, stk_hostNowNs() - t);
+    }
+}
+
+
+//------------------------------------------------
+//              FAST BOOT (user-024)
+//------------------------------------------------
+static void benchBoot(void)
+{
+    uint64_t luids[STK_ONFLASH_ENTRIES];
+    uint32_t n = gIters / 1000;
+    uint32_t lsteps = 0;
+    uint32_t i = 0;
+    uint64_t t = 0;
+
+    if (n == 0) {
+        n = 1;
+    }
+
+    benchReset();
+    benchFill(STK_ONFLASH_ENTRIES, luids);
+
+    t = stk_hostNowNs();
+    for (i = 0; i < n; i++) {
+        stk_dbIndexInit();
+    }
+    benchReport("boot.indexInit.full", n, stk_hostNowNs() - t);
+
+    // Fast boot: the first tap is served straight after stk_dbIndexBegin()
+    t = stk_hostNowNs();
+    for (i = 0; i < n; i++) {
+        stk_dbIndexBegin();
+        stk_tapCacheFlush();
+        CHECK(benchIsInDB(luids[STK_ONFLASH_ENTRIES - 1], false));
+    }
+    benchReport("boot.first_tap.fast", n, stk_hostNowNs() - t);
+
+    while (!stk_dbIndexStep(16)) {
+        lsteps++;
+    }
+    benchMetric("boot.index_steps.16_slots", lsteps + 1, "steps");
+    CHECK(stk_dbIndexVerify());
+}
+
+
+//------------------------------------------------
+//            POLL SCHEDULER (user-025)
+//------------------------------------------------
+static void benchPollTap(uint32_t when, uint64_t uid)
+{
+    int r = 0;
+
+    // A tap is several reads while the sticker is held
+    for (r = 0; r < 3; r++) {
+        gStkHostRtc = when + (r / 2);
+        stk_pollRecordTap(uid);
+    }
+}
+
+//
+// Power and latency of the cadences.  The firmware only picks the mode, what
+// a mode costs is the platform's: these are assumed figures for a battery
+// lock, change them to model another board.
+//
+#define BENCH_POLL_FAST_MS      (100)    // Poll to poll without the idle sleep
+#define BENCH_POLL_NORMAL_MS    (500)    // With it
+#define BENCH_POLL_CAP_SCAN_MS  (250)    // Capacitive sensing interval, CAP_ONLY
+#define BENCH_POLL_CAP_WAKE_MS  (60)     // Touch sensed to RF on
+#define BENCH_POLL_CAP_MISS_PCT (5)      // Taps the touch sensor misses (gloves, fob on a ring)...
+#define BENCH_POLL_RETRY_MS     (2000)   // ...and are tapped again after this
+#define BENCH_POLL_RF_UC        (300)    // One poll of an empty field, 10 ms at 30 mA
+#define BENCH_POLL_SLEEP_UA     (5)      // Between polls
+#define BENCH_POLL_CAP_UA       (3)      // Capacitive sensing, CAP_ONLY only
+#define BENCH_POLL_TAP_UC       (75000)  // One unlock, motor 150 mA for 0.5 s
+#define BENCH_POLL_BATTERY_MAH  (2500)
+#define BENCH_POLL_MAX_TAPS     (128)
+#define BENCH_POLL_SCHEDULER    (STK_POLL_NUM_MODES) // Policy: whatever stk_pollDecide() says
+
+static const char *gBenchPollPolicy[] = { "fast", "normal", "cap_only", "scheduler" };
+ct_assert(STK_POLL_FAST == 0);
+ct_assert(STK_POLL_NORMAL == 1);
+ct_assert(STK_POLL_CAP_ONLY == 2);
+
+// Average current in a mode
+static double benchPollUa(int mode)
+{
+    switch (mode) {
+    case STK_POLL_FAST:
+        return BENCH_POLL_SLEEP_UA + ((BENCH_POLL_RF_UC * 1000.0) / BENCH_POLL_FAST_MS);
+    case STK_POLL_NORMAL:
+        return BENCH_POLL_SLEEP_UA + ((BENCH_POLL_RF_UC * 1000.0) / BENCH_POLL_NORMAL_MS);
+    default:
+        return BENCH_POLL_SLEEP_UA + BENCH_POLL_CAP_UA;
+    }
+}
+
+// Sticker placed to decision.  phase (0..1) is where in the poll (or touch
+// sensing) period it was placed, missed if the touch sensor would miss it.
+static double benchPollDetectMs(int mode, double phase, bool missed)
+{
+    double ldecide = gBenchDetectUs / 1000.0;
+
+    switch (mode) {
+    case STK_POLL_FAST:
+        return (phase * BENCH_POLL_FAST_MS) + ldecide;
+    case STK_POLL_NORMAL:
+        return (phase * BENCH_POLL_NORMAL_MS) + ldecide;
+    default:
+        return (missed ? BENCH_POLL_RETRY_MS : 0) +
+               (phase * BENCH_POLL_CAP_SCAN_MS) + BENCH_POLL_CAP_WAKE_MS + ldecide;
+    }
+}
+
+static int benchCmpDouble(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double benchPercentile(const double *v, int n, int pct)
+{
+    double lsorted[BENCH_POLL_MAX_TAPS];
+    int    li = ((n * pct) + 99) / 100;
+
+    memcpy(lsorted, v, n * sizeof(double));
+    qsort(lsorted, n, sizeof(double), benchCmpDouble);
+    return lsorted[(li > 0) ? (li - 1) : 0];
+}
+
+//
+// Play taps (in time order) over the week from start under policy, a fixed
+// stk_poll_mode or BENCH_POLL_SCHEDULER, from the learned histogram.
+// Returns the battery life in days, lat[] gets each tap's detect latency.
+//
+static double benchPollWeek(int policy, const stk_poll_hist *learned, uint32_t start,
+                            const uint32_t *when, const uint64_t *uid, const double *phase,
+                            const bool *missed, int numTaps, double *lat)
+{
+    double lcharge = (double)numTaps * BENCH_POLL_TAP_UC; // uC
+    int    lmin = 0;
+    int    t = 0;
+
+    memcpy((uint8_t *)&gStkPollHist, (uint8_t *)learned, sizeof(gStkPollHist));
+    gStkPollLastTap  = 0;
+    gStkPollLastRead = 0;
+    gStkPollLastUid  = 0;
+
+    for (lmin = 0; lmin < (7 * 24 * 60); lmin++) {
+        uint32_t lnow = start + (lmin * 60);
+        int      lmode = policy;
+
+        gStkHostRtc = lnow;
+        if (policy == BENCH_POLL_SCHEDULER) {
+            lmode = stk_pollDecide();
+        }
+        lcharge += benchPollUa(lmode) * 60.0;
+
+        for (; (t < numTaps) && (when[t] < (lnow + 60)); t++) {
+            gStkHostRtc = when[t];
+            lat[t] = benchPollDetectMs((policy == BENCH_POLL_SCHEDULER) ? stk_pollDecide() : policy,
+                                       phase[t], missed[t]);
+            benchPollTap(when[t], uid[t]);
+        }
+    }
+
+    return (BENCH_POLL_BATTERY_MAH * 3.6e6) / (lcharge / 7.0);
+}
+
+// The week after training: the same habits, and a few taps at odd hours
+static void benchPollModel(const stk_poll_hist *learned, const uint64_t *users, uint32_t start)
+{
+    uint32_t lwhen[BENCH_POLL_MAX_TAPS];
+    uint64_t luid[BENCH_POLL_MAX_TAPS];
+    double   lphase[BENCH_POLL_MAX_TAPS];
+    bool     lmissed[BENCH_POLL_MAX_TAPS];
+    double   llat[BENCH_POLL_MAX_TAPS];
+    double   ldays[BENCH_POLL_SCHEDULER + 1];
+    double   lp50[BENCH_POLL_SCHEDULER + 1];
+    double   lp99[BENCH_POLL_SCHEDULER + 1];
+    char     lname[64];
+    int      lnum = 0;
+    int      d = 0;
+    int      u = 0;
+    int      p = 0;
+
+    for (d = 0; d < 7; d++) {
+        uint32_t lday = start + (d * 86400);
+        if ((d % 3) == 1) {
+            lwhen[lnum] = lday + (3 * 3600) + 600;  // Night
+            luid[lnum++] = users[7];
+        }
+        for (u = 0; u < 6; u++) {
+            lwhen[lnum] = lday + (8 * 3600) + (u * 400);
+            luid[lnum++] = users[u];
+        }
+        for (u = 0; u < 2; u++) {
+            lwhen[lnum] = lday + (12 * 3600) + (u * 900);
+            luid[lnum++] = users[u];
+        }
+        for (u = 0; u < 5; u++) {
+            lwhen[lnum] = lday + (17 * 3600) + (u * 500);
+            luid[lnum++] = users[u + 2];
+        }
+        if ((d % 3) == 2) {
+            lwhen[lnum] = lday + (22 * 3600) + 1800; // Late
+            luid[lnum++] = users[6];
+        }
+    }
+    for (u = 0; u < lnum; u++) {
+        lphase[u]  = (double)(benchRand() % 1000) / 1000.0;
+        lmissed[u] = (benchRand() % 100) < BENCH_POLL_CAP_MISS_PCT;
+    }
+
+    for (p = 0; p <= BENCH_POLL_SCHEDULER; p++) {
+        ldays[p] = benchPollWeek(p, learned, start, lwhen, luid, lphase, lmissed, lnum, llat);
+        lp50[p]  = benchPercentile(llat, lnum, 50);
+        lp99[p]  = benchPercentile(llat, lnum, 99);
+        snprintf(lname, sizeof(lname), "poll.model.%s.battery_days", gBenchPollPolicy[p]);
+        benchMetric(lname, ldays[p], "days");
+        snprintf(lname, sizeof(lname), "poll.model.%s.p50_detect_ms", gBenchPollPolicy[p]);
+        benchMetric(lname, lp50[p], "ms");
+        snprintf(lname, sizeof(lname), "poll.model.%s.p99_detect_ms", gBenchPollPolicy[p]);
+        benchMetric(lname, lp99[p], "ms");
+    }
+
+    // The point of the scheduler: longer than the normal rate on battery,
+    // and usually quicker to answer.  The tail is the odd-hour taps it left
+    // to the touch sensor.
+    CHECK(ldays[BENCH_POLL_SCHEDULER] > ldays[STK_POLL_NORMAL]);
+    CHECK(lp50[BENCH_POLL_SCHEDULER] < lp50[STK_POLL_NORMAL]);
+    CHECK(ldays[STK_POLL_FAST] < ldays[STK_POLL_NORMAL]);
+
+    memcpy((uint8_t *)&gStkPollHist, (uint8_t *)learned, sizeof(gStkPollHist));
+}
+
+static void benchPoll(void)
+{
+    uint64_t lusers[8];
+    uint32_t lday0 = 10 * 86400;
+    uint32_t lmodes[STK_POLL_NUM_MODES];
+    stk_poll_hist lhist;
+    int d = 0;
+    int u = 0;
+    int m = 0;
+
+    benchReset();
+    gStkHostWallClock = true;
+    for (u = 0; u < 8; u++) {
+        lusers[u] = benchUid();
+    }
+
+    // Four weeks: a morning rush, a few at lunch, an evening rush
+    for (d = 0; d < 28; d++) {
+        uint32_t lday = lday0 + (d * 86400);
+        for (u = 0; u < 6; u++) {
+            benchPollTap(lday + (8 * 3600) + (u * 400), lusers[u]);
+        }
+        for (u = 0; u < 2; u++) {
+            benchPollTap(lday + (12 * 3600) + (u * 900), lusers[u]);
+        }
+        for (u = 0; u < 5; u++) {
+            benchPollTap(lday + (17 * 3600) + (u * 500), lusers[u + 2]);
+        }
+    }
+
+    // A sticker left on the reader is read again every poll, but is one tap
+    memcpy((uint8_t *)&lhist, (uint8_t *)&gStkPollHist, sizeof(lhist));
+    for (m = 0; m < 50; m++) {
+        gStkHostRtc = lday0 + (29 * 86400) + (8 * 3600) + m;
+        stk_pollRecordTap(lusers[7]);
+    }
+    CHECK(stk_pollCount(8) <= (((lhist.hour[4] & 0x0FU) + 1) & 0x0FU));
+
+    // One decision a minute over a day
+    memset((uint8_t *)lmodes, 0, sizeof(lmodes));
+    for (m = 0; m < (24 * 60); m++) {
+        gStkHostRtc = lday0 + (30 * 86400) + (m * 60);
+        lmodes[stk_pollDecide()]++;
+    }
+    benchMetric("poll.day.fast", (100.0 * lmodes[STK_POLL_FAST]) / (24 * 60), "%");
+    benchMetric("poll.day.normal", (100.0 * lmodes[STK_POLL_NORMAL]) / (24 * 60), "%");
+    benchMetric("poll.day.cap_only", (100.0 * lmodes[STK_POLL_CAP_ONLY]) / (24 * 60), "%");
+
+    gStkHostRtc = lday0 + (31 * 86400) + (3 * 3600);
+    CHECK(stk_pollDecide() == STK_POLL_CAP_ONLY);
+    gStkHostRtc = lday0 + (31 * 86400) + (8 * 3600);
+    CHECK(stk_pollDecide() == STK_POLL_FAST);
+
+    // Battery life vs detect latency, per cadence and with the scheduler
+    memcpy((uint8_t *)&lhist, (uint8_t *)&gStkPollHist, sizeof(lhist));
+    benchPollModel(&lhist, lusers, lday0 + (32 * 86400));
+
+    // Without a wall clock: nothing learned, normal rate
+    gStkHostWallClock = false;
+    gStkHostRtc = lday0 + (31 * 86400) + (3 * 3600);
+    CHECK(stk_pollDecide() == STK_POLL_NORMAL);
+}
+
+
+//------------------------------------------------
+//       ACCESS LOG (user-011) and EXPORT (020)
+//------------------------------------------------
+static void benchLog(const char *logPath)
+{
+    static uint8_t lbuf[STK_LOG_NUM_RECS * STK_LOG_REC_LEN];
+    uint32_t n = 5000;
+    uint32_t i = 0;
+    uint16_t lcursor = 0;
+    uint16_t lnum = 0;
+    uint16_t lgot = 0;
+    uint64_t t = 0;
+
+    benchReset();
+    stk_logInit();
+
+    t = stk_hostNowNs();
+    for (i = 0; i < n; i++) {
+        gStkHostRtc += 17;
+        CHECK(stk_logAppend((int)(i % STK_ONFLASH_ENTRIES), STKFUNC_REGULAR, STK_LOG_RESULT_ALLOWED));
+        if ((i % 64) == 0) {
+            stk_logService();
+        }
+    }
+    benchReport("log.append", n, stk_hostNowNs() - t);
+
+    while ((lgot = stk_logRead(&lcursor, &lbuf[lnum * STK_LOG_REC_LEN], 64)) != 0) {
+        lnum += lgot;
+    }
+    benchMetric("log.records_kept", lnum, "records");
+    CHECK(lnum >= ((STK_LOG_NUM_SECTORS - 2) * STK_LOG_RECS_PER_SECTOR));
+
+    // Oldest first, consecutive, ending with the last append
+    for (i = 1; i < lnum; i++) {
+        stk_log_rec *lprev = (stk_log_rec *)&lbuf[(i - 1) * STK_LOG_REC_LEN];
+        stk_log_rec *lrec  = (stk_log_rec *)&lbuf[i * STK_LOG_REC_LEN];
+        CHECK(lrec->seq == (uint16_t)(lprev->seq + 1));
+    }
+    CHECK(((stk_log_rec *)&lbuf[(lnum - 1) * STK_LOG_REC_LEN])->slot == ((n - 1) % STK_ONFLASH_ENTRIES));
+
+    // Reboot finds the head again
+    stk_logInit();
+    CHECK(gStkLog.seq == (uint16_t)(n + 2));
+
+    if (logPath != NULL) {
+        FILE *f = fopen(logPath, "wb");
+        CHECK(f != NULL);
+        if (f != NULL) {
+            fwrite(lbuf, STK_LOG_REC_LEN, lnum, f);
+            fclose(f);
+        }
+    }
+}
+
+static void benchExport(const char *exportPath)
+{
+    uint8_t  lbuf[STK_STATS_EXPORT_LEN + 16];
+    uint16_t llen = 0;
+    uint32_t ldigest = 0;
+
+    // The export changes nothing (user-020), so the hourly write-back
+    // still runs after one
+    CHECK(stk_dbAddUid(benchUid(), false, false));
+    CHECK(stk_commitRamFlash());
+    llen = stk_statsExport(lbuf, sizeof(lbuf));
+    CHECK(!stk_isDirty());
+    memcpy((uint8_t *)&ldigest, &lbuf[llen - (5 * 4)], 4);
+    CHECK(ldigest == stk_dbDigestRoot());
+    gStkHostEepromWrites = 0;
+    gStkHostRtc += STK_STATS_PERSIST_SEC + 1;
+    stk_statsService();
+    CHECK(gStkHostEepromWrites != 0);
+
+    llen = stk_statsExport(lbuf, sizeof(lbuf));
+    CHECK(llen == STK_STATS_EXPORT_LEN);
+    CHECK(lbuf[0] == STK_STATS_VERSION);
+    CHECK(lbuf[1] == STK_STAGE_COUNT);
+    CHECK(stk_statsExport(lbuf, STK_STATS_EXPORT_LEN - 1) == 0);
+    benchMetric("stats.export_len", llen, "bytes");
+
+    if (exportPath != NULL) {
+        FILE *f = fopen(exportPath, "wb");
+        CHECK(f != NULL);
+        if (f != NULL) {
+            fwrite(lbuf, 1, llen, f);
+            fclose(f);
+        }
+    }
+}
+
+
+int main(int argc, char **argv)
+{
+    const char *lexport = NULL;
+    const char *llog = NULL;
+    int i = 0;
+
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--check") == 0) {
+            gIters = 2000;
+        } else if (strcmp(argv[i], "-v") == 0) {
+            gStkHostVerbose = true;
+        } else if ( (strcmp(argv[i], "--export") == 0) && ((i + 1) < argc) ) {
+            lexport = argv[++i];
+        } else if ( (strcmp(argv[i], "--log") == 0) && ((i + 1) < argc) ) {
+            llog = argv[++i];
+        } else {
+            fprintf(stderr, "usage: %s [--check] [-v] [--export FILE] [--log FILE]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    benchCrc();
+    benchLookupFill(0);
+    benchLookupFill(50);
+    benchLookupFill(100);
+    benchScan();
+    benchChurn();
+    benchStickers();
+    benchPaste();
+    benchDelta();
+    benchSpan();
+    benchTruST25();
+    benchReads();
+    benchField();
+    benchDetect();
+    benchBoot();
+    benchPoll();
+    benchLog(llog);
+    benchExport(lexport); // Last, so the histograms have the whole run
+
+    if (gFails != 0) {
+        fprintf(stderr, "%d check(s) failed\n", gFails);
+        return 1;
+    }
+    return 0;
+}
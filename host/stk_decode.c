@@ -0,0 +1,195 @@
+//------------------------------------------------
+// Copyright (c) 2022 stickLabs.io  All rights reserved.
+//------------------------------------------------
+//
+// Decodes what a lock hands over, on the host:
+//
+//     stk_decode DEBUG_INFO [--log ACCESS_LOG]
+//
+// DEBUG_INFO is an STKFUNC_GET_DEBUG_INFO blob (stk_statsExport()),
+// ACCESS_LOG an STKFUNC_GET_ACCESS_LOGS read-out (stk_logRead() records,
+// oldest first).  Standalone: the formats are the ones documented in
+// stickLabs.c, and the debug info is walked by the counts in its header, so
+// exports with more stages, buckets or counters still decode.
+//
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#define DEC_LOG_REC_LEN         (8)
+#define DEC_LOG_TIME_SYNC       (0x7FU)
+#define DEC_LOG_SLOT_NONE       (0xFFFFU)
+
+// Names for version 1 exports, in stk_stage / lcounters[] order.  Anything
+// past the end is printed by number.
+static const char *gDecStages[] = {
+    "field_detect", "anticoll", "always_read", "crc", "db_lookup", "actuate",
+};
+static const char *gDecCounters[] = {
+    "taps", "read_fails", "read_txns", "spec_wasted",
+    "tap_cache_hits", "tap_cache_misses", "truST25_checks", "truST25_cache_hits",
+    "poll_fast", "poll_normal", "poll_cap_only", "db_digest",
+    "field_polls_0", "field_polls_1", "field_polls_2", "field_polls_3",
+};
+#define DEC_NUM(a)  (sizeof(a) / sizeof((a)[0]))
+
+static uint32_t decLe(const uint8_t *p, int len)
+{
+    uint32_t v = 0;
+
+    while (len--) {
+        v = (v << 8) | p[len];
+    }
+    return v;
+}
+
+static long decReadFile(const char *path, uint8_t *buf, long bufLen)
+{
+    FILE *f = fopen(path, "rb");
+    long  llen = 0;
+
+    if (f == NULL) {
+        fprintf(stderr, "%s: cannot open\n", path);
+        return -1;
+    }
+    llen = (long)fread(buf, 1, (size_t)bufLen, f);
+    fclose(f);
+    return llen;
+}
+
+static int decStats(const uint8_t *buf, long len)
+{
+    const uint8_t *p = buf;
+    const uint8_t *end = buf + len;
+    unsigned lstages = 0;
+    unsigned lbuckets = 0;
+    unsigned lshift = 0;
+    unsigned lcounters = 0;
+    unsigned s = 0;
+    unsigned b = 0;
+
+    if (len < 4) {
+        fprintf(stderr, "debug info: short header\n");
+        return 1;
+    }
+    lstages  = p[1];
+    lbuckets = p[2];
+    lshift   = p[3];
+    printf("debug info version %u, %u stages, %u buckets, unit %u cycles\n",
+           p[0], lstages, lbuckets, 1U << lshift);
+    p += 4;
+
+    for (s = 0; s < lstages; s++) {
+        if ((p + 4 + (2 * lbuckets)) > end) {
+            fprintf(stderr, "debug info: truncated in stage %u\n", s);
+            return 1;
+        }
+        if (s < DEC_NUM(gDecStages)) {
+            printf("  %-14s", gDecStages[s]);
+        } else {
+            printf("  stage%-9u", s);
+        }
+        printf(" max %10u  ", decLe(p, 4));
+        p += 4;
+        for (b = 0; b < lbuckets; b++) {
+            printf(" %5u", decLe(p, 2));
+            p += 2;
+        }
+        printf("\n");
+    }
+
+    if (p >= end) {
+        fprintf(stderr, "debug info: no counters\n");
+        return 1;
+    }
+    lcounters = *p++;
+    if ((p + (4 * lcounters)) > end) {
+        fprintf(stderr, "debug info: truncated counters\n");
+        return 1;
+    }
+    for (s = 0; s < lcounters; s++) {
+        if (s < DEC_NUM(gDecCounters)) {
+            printf("  %-20s", gDecCounters[s]);
+        } else {
+            printf("  counter%-13u", s);
+        }
+        printf(" %u\n", decLe(p, 4));
+        p += 4;
+    }
+    return 0;
+}
+
+static int decLog(const uint8_t *buf, long len)
+{
+    uint32_t ltime = 0;
+    int      lsynced = 0;
+    long     lnum = len / DEC_LOG_REC_LEN;
+    long     i = 0;
+
+    if ((len % DEC_LOG_REC_LEN) != 0) {
+        fprintf(stderr, "access log: %ld trailing bytes ignored\n", len % DEC_LOG_REC_LEN);
+    }
+    printf("access log, %ld records\n", lnum);
+
+    for (i = 0; i < lnum; i++) {
+        const uint8_t *r = &buf[i * DEC_LOG_REC_LEN];
+        uint32_t lseq   = decLe(&r[0], 2);
+        uint32_t lslot  = decLe(&r[2], 2);
+        uint32_t ldelta = decLe(&r[4], 2);
+
+        if (r[7] == DEC_LOG_TIME_SYNC) {
+            ltime = (lslot << 16) | ldelta;
+            lsynced = 1;
+            printf("  %5u  time sync %u\n", lseq, ltime);
+            continue;
+        }
+        ltime += ldelta;
+        printf("  %5u  %c%10u  ", lseq, lsynced ? ' ' : '~', ltime);
+        if (lslot == DEC_LOG_SLOT_NONE) {
+            printf("slot    -");
+        } else {
+            printf("slot %4u", lslot);
+        }
+        printf("  function %3u  %s\n", r[6],
+               (r[7] == 0x01U) ? "allowed" :
+               (r[7] == 0x02U) ? "denied" :
+               (r[7] == 0x03U) ? "function" : "?");
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    static uint8_t lbuf[256 * 1024];
+    const char *lstats = NULL;
+    const char *llog = NULL;
+    long llen = 0;
+    int  lret = 0;
+    int  i = 0;
+
+    for (i = 1; i < argc; i++) {
+        if ( (strcmp(argv[i], "--log") == 0) && ((i + 1) < argc) ) {
+            llog = argv[++i];
+        } else if (lstats == NULL) {
+            lstats = argv[i];
+        } else {
+            lstats = NULL;
+            break;
+        }
+    }
+    if ( (lstats == NULL) && (llog == NULL) ) {
+        fprintf(stderr, "usage: %s [DEBUG_INFO] [--log ACCESS_LOG]\n", argv[0]);
+        return 2;
+    }
+
+    if (lstats != NULL) {
+        llen = decReadFile(lstats, lbuf, sizeof(lbuf));
+        lret |= (llen < 0) ? 1 : decStats(lbuf, llen);
+    }
+    if (llog != NULL) {
+        llen = decReadFile(llog, lbuf, sizeof(lbuf));
+        lret |= (llen < 0) ? 1 : decLog(lbuf, llen);
+    }
+    return lret;
+}
@@ -0,0 +1,916 @@
+//------------------------------------------------
+// Copyright (c) 2022 stickLabs.io  All rights reserved.
+//------------------------------------------------
+//
+// Fleet store: the stk_onflash_data image of every lock in one
+// memory-mapped file, with an inverted index from sticker UID to locks.
+//
+//     stk_fleet FILE put LOCK IMAGE      store a cp_ofd image (stk_gen --out)
+//     stk_fleet FILE import ARCHIVE      every image of an stk_gen --archive
+//     stk_fleet FILE who UID             the locks UID opens
+//     stk_fleet FILE revoke UID          take UID out of every lock's image
+//     stk_fleet FILE diff LOCK LOCK      UIDs only in one of two locks
+//     stk_fleet --bench [LOCKS...] [--check]
+//
+// FILE is a fleet_hdr and then one fleet_rec per lock, in the order they
+// were added; it grows as locks are added.  Images are read and written in
+// place through the mapping, as the packed structs stickLabs.c uses.
+//
+// The index covers entries[] (the stickers stk_isInDB() accepts), not
+// master1.  It lives in RAM: it is built when FILE is opened, and
+// fleetPut() updates it from the difference between the old and new image
+// of a lock, so a put costs the UIDs that changed, not a rebuild.
+//
+// --bench builds synthetic fleets (1000 and 10000 locks by default; 100000
+// is a 400 MB file) in a temporary file and reports put, open, who, revoke
+// and diff times as JSON lines, like stk_bench; who is also timed as the
+// scan of every image it replaces.  With --check the index must agree with
+// that scan.
+//
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// The image layout, stk_ofdSeal() and the page CRCs; the rest is not used
+// here
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-function"
+#include "../stickLabs.c"
+#pragma GCC diagnostic pop
+#include "stk_host.h"
+
+#define FLEET_MAGIC    (0x464B5453UL) // "STKF"
+#define FLEET_VERSION  (1)
+
+typedef struct __attribute__((__packed__))
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t imageLen;   // STK_ONFLASH_DATA_LEN
+    uint32_t numLocks;
+    uint32_t rfu;
+} fleet_hdr;
+
+typedef struct __attribute__((__packed__))
+{
+    uint32_t lock;
+    uint32_t rfu;
+    stk_onflash_data img;
+} fleet_rec;
+
+// stk_gen --archive: this header, numLocks fleet_archive_idx, the images
+#define FLEET_ARCHIVE_MAGIC  (0x414B5453UL) // "STKA"
+
+typedef struct __attribute__((__packed__))
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t imageLen;
+    uint32_t numLocks;
+} fleet_archive_hdr;
+
+typedef struct __attribute__((__packed__))
+{
+    uint32_t lock;
+    uint32_t offset;
+} fleet_archive_idx;
+
+// Open addressing, key 0 is a free slot
+typedef struct
+{
+    uint64_t *keys;
+    uint32_t *vals;
+    uint32_t  cap;       // A power of 2
+    uint32_t  cnt;
+} fleet_map;
+
+// The locks (record numbers) one UID is in, sorted
+typedef struct
+{
+    uint32_t *recs;
+    uint32_t  n;
+    uint32_t  cap;
+} fleet_posting;
+
+typedef struct
+{
+    int        fd;
+    uint8_t   *map;
+    size_t     mapLen;
+    uint32_t   capacity; // Records the mapping has room for
+    fleet_map  locks;    // lock + 1 -> record
+    fleet_map  uids;     // UID -> post[]
+    fleet_posting *post;
+    uint32_t   numPost;
+    uint32_t   capPost;
+} fleet;
+
+static int gFleetFails;
+
+#define CHECK(e)                                                            \
+    do {                                                                    \
+        if (!(e)) {                                                         \
+            fprintf(stderr, "FAIL %s:%d: %s\n", __FILE__, __LINE__, #e);    \
+            gFleetFails++;                                                  \
+        }                                                                   \
+    } while (0)
+
+
+//------------------------------------------------
+//                  HASH MAP
+//------------------------------------------------
+static uint32_t fleetHash(const fleet_map *m, uint64_t key)
+{
+    return (uint32_t)((key * 0x9E3779B97F4A7C15ULL) >> 32) & (m->cap - 1);
+}
+
+static bool fleetMapInit(fleet_map *m, uint32_t cap)
+{
+    m->cap  = cap;
+    m->cnt  = 0;
+    m->keys = calloc(cap, sizeof(uint64_t));
+    m->vals = calloc(cap, sizeof(uint32_t));
+    return (m->keys != NULL) && (m->vals != NULL);
+}
+
+static void fleetMapFree(fleet_map *m)
+{
+    free(m->keys);
+    free(m->vals);
+    memset((uint8_t *)m, 0, sizeof(*m));
+}
+
+static uint32_t *fleetMapFind(const fleet_map *m, uint64_t key)
+{
+    uint32_t h = fleetHash(m, key);
+
+    while (m->keys[h] != 0) {
+        if (m->keys[h] == key) {
+            return &m->vals[h];
+        }
+        h = (h + 1) & (m->cap - 1);
+    }
+    return NULL;
+}
+
+static bool fleetMapPut(fleet_map *m, uint64_t key, uint32_t val)
+{
+    uint32_t h = 0;
+
+    if (((m->cnt + 1) * 2) > m->cap) {
+        fleet_map lbig;
+        uint32_t  i = 0;
+
+        if (!fleetMapInit(&lbig, m->cap * 2)) {
+            return false;
+        }
+        for (i = 0; i < m->cap; i++) {
+            if (m->keys[i] != 0) {
+                fleetMapPut(&lbig, m->keys[i], m->vals[i]);
+            }
+        }
+        fleetMapFree(m);
+        *m = lbig;
+    }
+
+    h = fleetHash(m, key);
+    while ((m->keys[h] != 0) && (m->keys[h] != key)) {
+        h = (h + 1) & (m->cap - 1);
+    }
+    if (m->keys[h] == 0) {
+        m->keys[h] = key;
+        m->cnt++;
+    }
+    m->vals[h] = val;
+    return true;
+}
+
+
+//------------------------------------------------
+//                INVERTED INDEX
+//------------------------------------------------
+static fleet_posting *fleetPosting(fleet *f, uint64_t uid, bool create)
+{
+    uint32_t *lval = fleetMapFind(&f->uids, uid);
+
+    if (lval != NULL) {
+        return &f->post[*lval];
+    }
+    if (!create) {
+        return NULL;
+    }
+
+    if (f->numPost == f->capPost) {
+        uint32_t lcap = (f->capPost == 0) ? 1024 : (f->capPost * 2);
+        fleet_posting *lgrown = realloc(f->post, lcap * sizeof(fleet_posting));
+        if (lgrown == NULL) {
+            return NULL;
+        }
+        f->post    = lgrown;
+        f->capPost = lcap;
+    }
+    if (!fleetMapPut(&f->uids, uid, f->numPost)) {
+        return NULL;
+    }
+    memset((uint8_t *)&f->post[f->numPost], 0, sizeof(fleet_posting));
+    return &f->post[f->numPost++];
+}
+
+// First position in p with recs[] >= rec
+static uint32_t fleetPostFind(const fleet_posting *p, uint32_t rec)
+{
+    uint32_t lo = 0;
+    uint32_t hi = p->n;
+
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        if (p->recs[mid] < rec) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+static bool fleetIndexAdd(fleet *f, uint64_t uid, uint32_t rec)
+{
+    fleet_posting *p = fleetPosting(f, uid, true);
+    uint32_t pos = 0;
+
+    if (p == NULL) {
+        return false;
+    }
+    pos = fleetPostFind(p, rec);
+    if ((pos < p->n) && (p->recs[pos] == rec)) {
+        return true;
+    }
+    if (p->n == p->cap) {
+        uint32_t  lcap = (p->cap == 0) ? 4 : (p->cap * 2);
+        uint32_t *lgrown = realloc(p->recs, lcap * sizeof(uint32_t));
+        if (lgrown == NULL) {
+            return false;
+        }
+        p->recs = lgrown;
+        p->cap  = lcap;
+    }
+    memmove(&p->recs[pos + 1], &p->recs[pos], (p->n - pos) * sizeof(uint32_t));
+    p->recs[pos] = rec;
+    p->n++;
+    return true;
+}
+
+static void fleetIndexDel(fleet *f, uint64_t uid, uint32_t rec)
+{
+    fleet_posting *p = fleetPosting(f, uid, false);
+    uint32_t pos = 0;
+
+    if (p == NULL) {
+        return;
+    }
+    pos = fleetPostFind(p, rec);
+    if ((pos < p->n) && (p->recs[pos] == rec)) {
+        memmove(&p->recs[pos], &p->recs[pos + 1], (p->n - pos - 1) * sizeof(uint32_t));
+        p->n--;
+    }
+}
+
+// Shell sort (Ciura's gaps): a few hundred UIDs, without qsort()'s calls
+static void fleetSortUids(uint64_t *uids, uint32_t num)
+{
+    static const uint32_t lgaps[] = { 132, 57, 23, 10, 4, 1 };
+    uint32_t g = 0;
+    uint32_t i = 0;
+
+    for (g = 0; g < (sizeof(lgaps) / sizeof(lgaps[0])); g++) {
+        uint32_t lgap = lgaps[g];
+        for (i = lgap; i < num; i++) {
+            uint64_t luid = uids[i];
+            uint32_t j = i;
+            while ( (j >= lgap) && (uids[j - lgap] > luid) ) {
+                uids[j] = uids[j - lgap];
+                j -= lgap;
+            }
+            uids[j] = luid;
+        }
+    }
+}
+
+// The distinct non-zero entries[] UIDs of img, sorted.  Returns how many.
+static uint32_t fleetImageUids(const stk_onflash_data *img, uint64_t *uids)
+{
+    uint32_t lnum = 0;
+    uint32_t lout = 0;
+    uint32_t i = 0;
+
+    for (i = 0; i < STK_ONFLASH_ENTRIES; i++) {
+        if (img->entries[i].uid != 0) {
+            uids[lnum++] = img->entries[i].uid;
+        }
+    }
+    fleetSortUids(uids, lnum);
+    for (i = 0; i < lnum; i++) {
+        if ((lout == 0) || (uids[lout - 1] != uids[i])) {
+            uids[lout++] = uids[i];
+        }
+    }
+    return lout;
+}
+
+//
+// Walk the sorted UID sets a and b: only(a[i], 0) for UIDs only in a,
+// only(b[i], 1) for those only in b.  Returns the number of differences.
+//
+typedef void (*fleet_diff_fn)(void *ctx, uint64_t uid, int side);
+
+static uint32_t fleetSetDiff(const uint64_t *a, uint32_t na, const uint64_t *b, uint32_t nb,
+                             fleet_diff_fn only, void *ctx)
+{
+    uint32_t i = 0;
+    uint32_t j = 0;
+    uint32_t lnum = 0;
+
+    while ((i < na) || (j < nb)) {
+        if ( (j == nb) || ((i < na) && (a[i] < b[j])) ) {
+            if (only != NULL) {
+                only(ctx, a[i], 0);
+            }
+            i++;
+            lnum++;
+        } else if ( (i == na) || (b[j] < a[i]) ) {
+            if (only != NULL) {
+                only(ctx, b[j], 1);
+            }
+            j++;
+            lnum++;
+        } else {
+            i++;
+            j++;
+        }
+    }
+    return lnum;
+}
+
+
+//------------------------------------------------
+//                    STORE
+//------------------------------------------------
+static fleet_hdr *fleetHdr(const fleet *f)
+{
+    return (fleet_hdr *)f->map;
+}
+
+static fleet_rec *fleetRec(const fleet *f, uint32_t rec)
+{
+    return (fleet_rec *)(f->map + sizeof(fleet_hdr) + ((size_t)rec * sizeof(fleet_rec)));
+}
+
+static bool fleetMap(fleet *f, uint32_t capacity)
+{
+    size_t llen = sizeof(fleet_hdr) + ((size_t)capacity * sizeof(fleet_rec));
+
+    if (f->map != NULL) {
+        munmap(f->map, f->mapLen);
+        f->map = NULL;
+    }
+    if (ftruncate(f->fd, (off_t)llen) != 0) {
+        return false;
+    }
+    f->map = mmap(NULL, llen, PROT_READ | PROT_WRITE, MAP_SHARED, f->fd, 0);
+    if (f->map == MAP_FAILED) {
+        f->map = NULL;
+        return false;
+    }
+    f->mapLen   = llen;
+    f->capacity = capacity;
+    return true;
+}
+
+static void fleetClose(fleet *f)
+{
+    uint32_t i = 0;
+
+    if (f->map != NULL) {
+        // Trim the room left for growth
+        size_t llen = sizeof(fleet_hdr) + ((size_t)fleetHdr(f)->numLocks * sizeof(fleet_rec));
+        munmap(f->map, f->mapLen);
+        if (ftruncate(f->fd, (off_t)llen) != 0) {
+            fprintf(stderr, "fleet: cannot trim\n");
+        }
+    }
+    if (f->fd >= 0) {
+        close(f->fd);
+    }
+    for (i = 0; i < f->numPost; i++) {
+        free(f->post[i].recs);
+    }
+    free(f->post);
+    fleetMapFree(&f->locks);
+    fleetMapFree(&f->uids);
+    memset((uint8_t *)f, 0, sizeof(*f));
+    f->fd = -1;
+}
+
+// Build the index from the images, as on open
+static bool fleetIndexBuild(fleet *f)
+{
+    uint64_t luids[STK_ONFLASH_ENTRIES];
+    uint32_t r = 0;
+    uint32_t k = 0;
+
+    for (r = 0; r < fleetHdr(f)->numLocks; r++) {
+        const fleet_rec *lrec = fleetRec(f, r);
+        uint32_t lnum = fleetImageUids(&lrec->img, luids);
+
+        if (!fleetMapPut(&f->locks, (uint64_t)lrec->lock + 1, r)) {
+            return false;
+        }
+        for (k = 0; k < lnum; k++) {
+            if (!fleetIndexAdd(f, luids[k], r)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static bool fleetOpen(fleet *f, const char *path)
+{
+    struct stat st;
+    fleet_hdr  *lhdr = NULL;
+    uint32_t    lcap = 0;
+
+    memset((uint8_t *)f, 0, sizeof(*f));
+    f->fd = open(path, O_RDWR | O_CREAT, 0644);
+    if ( (f->fd < 0) || (fstat(f->fd, &st) != 0) ) {
+        fprintf(stderr, "%s: cannot open\n", path);
+        return false;
+    }
+
+    if (st.st_size == 0) {
+        if (!fleetMap(f, 64)) {
+            return false;
+        }
+        lhdr = fleetHdr(f);
+        lhdr->magic    = FLEET_MAGIC;
+        lhdr->version  = FLEET_VERSION;
+        lhdr->imageLen = STK_ONFLASH_DATA_LEN;
+        lhdr->numLocks = 0;
+    } else {
+        fleet_hdr lpeek;
+        if ( (pread(f->fd, &lpeek, sizeof(lpeek), 0) != (ssize_t)sizeof(lpeek)) ||
+             (lpeek.magic != FLEET_MAGIC) || (lpeek.version != FLEET_VERSION) ||
+             (lpeek.imageLen != STK_ONFLASH_DATA_LEN) ||
+             ((size_t)st.st_size < (sizeof(fleet_hdr) + ((size_t)lpeek.numLocks * sizeof(fleet_rec)))) )
+        {
+            fprintf(stderr, "%s: not a fleet file\n", path);
+            return false;
+        }
+        lcap = lpeek.numLocks + 64;
+        if (!fleetMap(f, lcap)) {
+            return false;
+        }
+    }
+
+    return fleetMapInit(&f->locks, 1024) &&
+           fleetMapInit(&f->uids, 4096) &&
+           fleetIndexBuild(f);
+}
+
+static void fleetPutOnly(void *ctx, uint64_t uid, int side)
+{
+    void   **largs = (void **)ctx;
+    fleet   *f = (fleet *)largs[0];
+    uint32_t rec = *(uint32_t *)largs[1];
+
+    if (side == 0) {
+        fleetIndexDel(f, uid, rec); // Only in the old image
+    } else {
+        fleetIndexAdd(f, uid, rec);
+    }
+}
+
+//
+// Store the image of lock, adding the lock if it is new.  The index is
+// updated from the UIDs that differ between its old and new image.
+//
+static bool fleetPut(fleet *f, uint32_t lock, const stk_onflash_data *img)
+{
+    uint64_t lold[STK_ONFLASH_ENTRIES];
+    uint64_t lnew[STK_ONFLASH_ENTRIES];
+    uint32_t nold = 0;
+    uint32_t nnew = 0;
+    uint32_t lrec = 0;
+    uint32_t *lval = fleetMapFind(&f->locks, (uint64_t)lock + 1);
+    void    *largs[2];
+
+    if (lval != NULL) {
+        lrec = *lval;
+        nold = fleetImageUids(&fleetRec(f, lrec)->img, lold);
+    } else {
+        lrec = fleetHdr(f)->numLocks;
+        if ( (lrec == f->capacity) && !fleetMap(f, f->capacity * 2) ) {
+            return false;
+        }
+        if (!fleetMapPut(&f->locks, (uint64_t)lock + 1, lrec)) {
+            return false;
+        }
+        fleetRec(f, lrec)->lock = lock;
+        fleetHdr(f)->numLocks++;
+    }
+
+    nnew = fleetImageUids(img, lnew);
+    largs[0] = f;
+    largs[1] = &lrec;
+    fleetSetDiff(lold, nold, lnew, nnew, fleetPutOnly, largs);
+
+    memcpy((uint8_t *)&fleetRec(f, lrec)->img, (const uint8_t *)img, sizeof(*img));
+    return true;
+}
+
+// The locks uid is in: the index's records, valid until the next put
+static const uint32_t *fleetWho(const fleet *f, uint64_t uid, uint32_t *num)
+{
+    uint32_t *lval = fleetMapFind(&f->uids, uid);
+
+    if (lval == NULL) {
+        *num = 0;
+        return NULL;
+    }
+    *num = f->post[*lval].n;
+    return f->post[*lval].recs;
+}
+
+// What the index replaces: every image, one by one.  Returns the count.
+static uint32_t fleetWhoScan(const fleet *f, uint64_t uid)
+{
+    uint32_t lnum = 0;
+    uint32_t r = 0;
+    int      i = 0;
+
+    for (r = 0; r < fleetHdr(f)->numLocks; r++) {
+        const stk_onflash_data *limg = &fleetRec(f, r)->img;
+        for (i = 0; i < STK_ONFLASH_ENTRIES; i++) {
+            if (limg->entries[i].uid == uid) {
+                lnum++;
+                break;
+            }
+        }
+    }
+    return lnum;
+}
+
+//
+// Take uid out of every image it is in, resealed (numBlks, CRC, page
+// digest) as stk_gen would have made it.  Returns the number of locks.
+//
+static uint32_t fleetRevoke(fleet *f, uint64_t uid)
+{
+    stk_onflash_data limg;
+    uint32_t lnum = 0;
+    const uint32_t *lrecs = fleetWho(f, uid, &lnum);
+    uint32_t lleft = lnum;
+    int      i = 0;
+
+    // fleetPut() takes each record out of the posting list being walked
+    while (lleft > 0) {
+        uint32_t lrec = lrecs[lleft - 1];
+
+        memcpy((uint8_t *)&limg, (uint8_t *)&fleetRec(f, lrec)->img, sizeof(limg));
+        for (i = 0; i < STK_ONFLASH_ENTRIES; i++) {
+            if (limg.entries[i].uid == uid) {
+                memset((uint8_t *)&limg.entries[i], 0, sizeof(limg.entries[i]));
+            }
+        }
+        stk_ofdSeal(&limg);
+        fleetPut(f, fleetRec(f, lrec)->lock, &limg);
+        lrecs = fleetWho(f, uid, &lleft);
+    }
+    return lnum;
+}
+
+static void fleetDiffPrint(void *ctx, uint64_t uid, int side)
+{
+    const uint32_t *llocks = (const uint32_t *)ctx;
+    printf("%016llX only in %u\n", (unsigned long long)uid, llocks[side]);
+}
+
+//
+// UIDs only in one of two sealed images.  Equal page digests (what
+// stk_ofdSeal() stores in reserved1/reserved2) settle identical images
+// without looking at the entries.
+//
+static uint32_t fleetDiff(const stk_onflash_data *a, const stk_onflash_data *b,
+                          fleet_diff_fn only, void *ctx)
+{
+    uint64_t la[STK_ONFLASH_ENTRIES];
+    uint64_t lb[STK_ONFLASH_ENTRIES];
+    uint32_t na = 0;
+    uint32_t nb = 0;
+
+    if (memcmp((const uint8_t *)&a->reserved1, (const uint8_t *)&b->reserved1, sizeof(stk_db_digest)) == 0) {
+        return 0;
+    }
+
+    na = fleetImageUids(a, la);
+    nb = fleetImageUids(b, lb);
+    return fleetSetDiff(la, na, lb, nb, only, ctx);
+}
+
+
+//------------------------------------------------
+//                  BENCHMARK
+//------------------------------------------------
+#define FLEET_BENCH_PER_LOCK  (150)
+#define FLEET_BENCH_USERS     (20000)
+
+static uint64_t gFleetRnd = 0x5EEDF00DULL;
+
+static uint64_t fleetRand(void)
+{
+    gFleetRnd ^= gFleetRnd << 13;
+    gFleetRnd ^= gFleetRnd >> 7;
+    gFleetRnd ^= gFleetRnd << 17;
+    return gFleetRnd;
+}
+
+static uint64_t fleetBenchUser(void)
+{
+    return 0xE002000000000000ULL | ((fleetRand() % FLEET_BENCH_USERS) + 1);
+}
+
+static void fleetBenchImage(stk_onflash_data *img)
+{
+    int i = 0;
+
+    memset((uint8_t *)img, 0, sizeof(*img));
+    img->master1.uid = 0xE002100000000000ULL | (fleetRand() & 0xFFFFFFFFULL);
+    img->master1.meta1_truST25_mast = STK_ENTRY_META1_ISMASTER;
+    for (i = 0; i < FLEET_BENCH_PER_LOCK; i++) {
+        img->entries[i].uid = fleetBenchUser();
+    }
+    stk_ofdSeal(img);
+}
+
+static void fleetReport(const char *what, uint32_t locks, uint32_t n, uint64_t ns)
+{
+    double lns = (double)ns / (double)n;
+    printf("{\"bench\":\"fleet.%s.locks%u\",\"n\":%u,\"ns\":%.1f}\n", what, locks, n, lns);
+}
+
+static void fleetBench(uint32_t numLocks, bool check)
+{
+    static const char *lpath = "stk_fleet_bench.stkf";
+    stk_onflash_data limg;
+    fleet    lf;
+    uint32_t n = 1000;
+    uint32_t lsum = 0;
+    uint32_t i = 0;
+    uint64_t t = 0;
+
+    unlink(lpath);
+    if (!fleetOpen(&lf, lpath)) {
+        gFleetFails++;
+        return;
+    }
+
+    t = stk_hostNowNs();
+    for (i = 0; i < numLocks; i++) {
+        fleetBenchImage(&limg);
+        CHECK(fleetPut(&lf, i + 1, &limg));
+    }
+    fleetReport("put_new", numLocks, numLocks, stk_hostNowNs() - t);
+
+    // Reopen: the index is rebuilt from the mapped images
+    fleetClose(&lf);
+    t = stk_hostNowNs();
+    CHECK(fleetOpen(&lf, lpath));
+    fleetReport("open", numLocks, 1, stk_hostNowNs() - t);
+
+    t = stk_hostNowNs();
+    for (i = 0; i < n; i++) {
+        uint32_t lnum = 0;
+        fleetWho(&lf, fleetBenchUser(), &lnum);
+        lsum += lnum;
+    }
+    fleetReport("who", numLocks, n, stk_hostNowNs() - t);
+
+    t = stk_hostNowNs();
+    for (i = 0; i < (n / 100); i++) {
+        lsum += fleetWhoScan(&lf, fleetBenchUser());
+    }
+    fleetReport("who_scan", numLocks, n / 100, stk_hostNowNs() - t);
+
+    // A lock's image changes a little (a few enrolled, a few revoked)
+    t = stk_hostNowNs();
+    for (i = 0; i < n; i++) {
+        uint32_t lrec = (uint32_t)(fleetRand() % numLocks);
+        memcpy((uint8_t *)&limg, (uint8_t *)&fleetRec(&lf, lrec)->img, sizeof(limg));
+        limg.entries[fleetRand() % FLEET_BENCH_PER_LOCK].uid = fleetBenchUser();
+        limg.entries[fleetRand() % FLEET_BENCH_PER_LOCK].uid = fleetBenchUser();
+        stk_ofdSeal(&limg);
+        CHECK(fleetPut(&lf, fleetRec(&lf, lrec)->lock, &limg));
+    }
+    fleetReport("put_change", numLocks, n, stk_hostNowNs() - t);
+
+    t = stk_hostNowNs();
+    for (i = 0; i < n; i++) {
+        uint32_t a = (uint32_t)(fleetRand() % numLocks);
+        uint32_t b = (uint32_t)(fleetRand() % numLocks);
+        lsum += fleetDiff(&fleetRec(&lf, a)->img, &fleetRec(&lf, b)->img, NULL, NULL);
+    }
+    fleetReport("diff", numLocks, n, stk_hostNowNs() - t);
+
+    // Revoke everywhere: a lost sticker.  Only fleetRevoke() is timed.
+    t = 0;
+    for (i = 0; i < 10; i++) {
+        uint64_t luid = fleetBenchUser();
+        uint32_t lnum = 0;
+        uint32_t lbefore = check ? fleetWhoScan(&lf, luid) : 0;
+        uint64_t lt0 = stk_hostNowNs();
+
+        lsum += fleetRevoke(&lf, luid);
+        t += stk_hostNowNs() - lt0;
+        fleetWho(&lf, luid, &lnum);
+        CHECK(lnum == 0);
+        if (check) {
+            CHECK(lbefore > 0);
+            CHECK(fleetWhoScan(&lf, luid) == 0);
+        }
+    }
+    fleetReport("revoke", numLocks, 10, t);
+
+    // The incrementally kept index is the one a rebuild gives
+    if (check) {
+        for (i = 0; i < 200; i++) {
+            uint64_t luid = fleetBenchUser();
+            uint32_t lnum = 0;
+            fleetWho(&lf, luid, &lnum);
+            CHECK(lnum == fleetWhoScan(&lf, luid));
+        }
+        CHECK(stk_ofdCrc(&fleetRec(&lf, 0)->img, fleetRec(&lf, 0)->img.op_mode.numBlks) ==
+              fleetRec(&lf, 0)->img.op_mode.crc);
+    }
+
+    fleetClose(&lf);
+    unlink(lpath);
+    if (lsum == 0) {
+        fprintf(stderr, "fleet: empty benchmark\n");
+    }
+}
+
+
+//------------------------------------------------
+//                     CLI
+//------------------------------------------------
+static bool fleetReadImage(const char *path, stk_onflash_data *img)
+{
+    FILE *fp = fopen(path, "rb");
+    bool  lok = false;
+
+    if (fp == NULL) {
+        fprintf(stderr, "%s: cannot open\n", path);
+        return false;
+    }
+    lok = fread(img, 1, sizeof(*img), fp) == sizeof(*img);
+    fclose(fp);
+    if (!lok || (img->op_mode.numBlks > STK_ONFLASH_NUM_MEMBERS) ||
+        (stk_ofdCrc(img, img->op_mode.numBlks) != img->op_mode.crc))
+    {
+        fprintf(stderr, "%s: not a sealed cp_ofd image\n", path);
+        return false;
+    }
+    return true;
+}
+
+static int fleetImport(fleet *f, const char *path)
+{
+    FILE *fp = fopen(path, "rb");
+    stk_onflash_data  limg;
+    fleet_archive_hdr lhdr;
+    uint32_t i = 0;
+    int      lret = 0;
+
+    if (fp == NULL) {
+        fprintf(stderr, "%s: cannot open\n", path);
+        return 1;
+    }
+    if ( (fread(&lhdr, 1, sizeof(lhdr), fp) != sizeof(lhdr)) ||
+         (lhdr.magic != FLEET_ARCHIVE_MAGIC) || (lhdr.imageLen != STK_ONFLASH_DATA_LEN) )
+    {
+        fprintf(stderr, "%s: not an stk_gen archive\n", path);
+        fclose(fp);
+        return 1;
+    }
+
+    for (i = 0; (i < lhdr.numLocks) && (lret == 0); i++) {
+        fleet_archive_idx lidx;
+        if ( (fseek(fp, (long)(sizeof(lhdr) + (i * sizeof(lidx))), SEEK_SET) != 0) ||
+             (fread(&lidx, 1, sizeof(lidx), fp) != sizeof(lidx)) ||
+             (fseek(fp, (long)lidx.offset, SEEK_SET) != 0) ||
+             (fread(&limg, 1, sizeof(limg), fp) != sizeof(limg)) ||
+             !fleetPut(f, lidx.lock, &limg) )
+        {
+            fprintf(stderr, "%s: lock %u failed\n", path, i);
+            lret = 1;
+        }
+    }
+    fclose(fp);
+    printf("%u locks imported\n", lret ? (i - 1) : i);
+    return lret;
+}
+
+static uint32_t fleetArgLock(const fleet *f, const char *arg, bool *ok)
+{
+    uint32_t *lval = fleetMapFind(&f->locks, (uint64_t)strtoul(arg, NULL, 10) + 1);
+
+    *ok = (lval != NULL);
+    if (!*ok) {
+        fprintf(stderr, "lock %s: not in the fleet\n", arg);
+        return 0;
+    }
+    return *lval;
+}
+
+int main(int argc, char **argv)
+{
+    fleet    lf;
+    int      lret = 0;
+    bool     lcheck = false;
+    bool     lok = false;
+    uint32_t lnum = 0;
+    uint32_t i = 0;
+    int      a = 0;
+
+    if ( (argc >= 2) && (strcmp(argv[1], "--bench") == 0) ) {
+        uint32_t lsizes[8];
+        int      lnumSizes = 0;
+
+        for (a = 2; a < argc; a++) {
+            if (strcmp(argv[a], "--check") == 0) {
+                lcheck = true;
+            } else if (lnumSizes < 8) {
+                lsizes[lnumSizes++] = (uint32_t)strtoul(argv[a], NULL, 10);
+            }
+        }
+        if (lnumSizes == 0) {
+            lsizes[lnumSizes++] = 1000;
+            lsizes[lnumSizes++] = 10000;
+        }
+        for (a = 0; a < lnumSizes; a++) {
+            if (lsizes[a] > 0) {
+                fleetBench(lsizes[a], lcheck);
+            }
+        }
+        if (gFleetFails != 0) {
+            fprintf(stderr, "%d check(s) failed\n", gFleetFails);
+            return 1;
+        }
+        return 0;
+    }
+
+    if (argc < 4) {
+        fprintf(stderr, "usage: %s FILE (put LOCK IMAGE | import ARCHIVE | who UID | revoke UID | diff LOCK LOCK)\n"
+                        "       %s --bench [LOCKS...] [--check]\n", argv[0], argv[0]);
+        return 2;
+    }
+    if (!fleetOpen(&lf, argv[1])) {
+        return 1;
+    }
+
+    if ( (strcmp(argv[2], "put") == 0) && (argc == 5) ) {
+        stk_onflash_data limg;
+        lret = !(fleetReadImage(argv[4], &limg) &&
+                 fleetPut(&lf, (uint32_t)strtoul(argv[3], NULL, 10), &limg));
+    } else if (strcmp(argv[2], "import") == 0) {
+        lret = fleetImport(&lf, argv[3]);
+    } else if (strcmp(argv[2], "who") == 0) {
+        const uint32_t *lrecs = fleetWho(&lf, strtoull(argv[3], NULL, 16), &lnum);
+        for (i = 0; i < lnum; i++) {
+            printf("%u\n", fleetRec(&lf, lrecs[i])->lock);
+        }
+    } else if (strcmp(argv[2], "revoke") == 0) {
+        printf("%u locks\n", fleetRevoke(&lf, strtoull(argv[3], NULL, 16)));
+    } else if ( (strcmp(argv[2], "diff") == 0) && (argc == 5) ) {
+        uint32_t lrecA = fleetArgLock(&lf, argv[3], &lok);
+        uint32_t lrecB = lok ? fleetArgLock(&lf, argv[4], &lok) : 0;
+        uint32_t llocks[2];
+        if (lok) {
+            llocks[0] = fleetRec(&lf, lrecA)->lock;
+            llocks[1] = fleetRec(&lf, lrecB)->lock;
+            fleetDiff(&fleetRec(&lf, lrecA)->img, &fleetRec(&lf, lrecB)->img, fleetDiffPrint, llocks);
+        }
+        lret = !lok;
+    } else {
+        fprintf(stderr, "%s: unknown command\n", argv[2]);
+        lret = 2;
+    }
+
+    fleetClose(&lf);
+    return lret;
+}
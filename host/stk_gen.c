@@ -0,0 +1,557 @@
+//------------------------------------------------
+// Copyright (c) 2022 stickLabs.io  All rights reserved.
+//------------------------------------------------
+//
+// Bulk generator of STKFUNC_CONFIG_PAYLOAD images, from an access matrix:
+//
+//     stk_gen [-j THREADS] (--out DIR | --archive FILE) MATRIX.csv
+//     stk_gen --bench [LOCKS] [--check]
+//
+// MATRIX.csv has one "lock,uid[,flags]" line per sticker a lock accepts: lock
+// a decimal ID, uid the UID in hex as stk_nfcDev_or_backupStk() returns it
+// (E002...), flags m for master1 and t for TruST25.  Lines of a lock need not
+// be together, '#' starts a comment.
+//
+// Each lock gets the cp_ofd of its config payload sticker, sealed with
+// stk_ofdSeal(): the STK_ONFLASH_DATA_LEN bytes written from block
+// STK_CP_OFD_START_BLOCK.  cp_dat is not generated.  It is written in the
+// factory, and its stk_dat_always CRC is computed outside this tree.
+//
+// --out writes DIR/<lock>.ofd per lock.  --archive writes one file: a
+// gen_archive_hdr, one gen_archive_idx per lock sorted by lock, then the
+// images in the same order.
+//
+// Workers take locks in batches of GEN_BATCH from a shared counter, so a
+// slow batch does not hold the others up, and build every image in their own
+// buffer: nothing is allocated per image.  Archive images have fixed offsets
+// and are written with pwrite() straight from that buffer.
+//
+// --bench generates a synthetic fleet with 1, 2, 4... threads up to the core
+// count (or -j) and prints images/sec as JSON lines, like stk_bench.  With --check
+// every thread count must produce the same images (exit status 1 if not).
+//
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+
+// The image layout, stk_ofdSeal() and the CRC; the rest is not used here
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-function"
+#include "../stickLabs.c"
+#pragma GCC diagnostic pop
+#include "stk_host.h"
+
+#define GEN_BATCH            (16)
+#define GEN_MAX_THREADS      (64)
+#define GEN_ARCHIVE_MAGIC    (0x414B5453UL) // "STKA"
+#define GEN_ARCHIVE_VERSION  (1)
+
+typedef struct __attribute__((__packed__))
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t imageLen;   // STK_ONFLASH_DATA_LEN
+    uint32_t numLocks;
+} gen_archive_hdr;
+
+typedef struct __attribute__((__packed__))
+{
+    uint32_t lock;
+    uint32_t offset;     // Of its image, from the start of the file
+} gen_archive_idx;
+
+typedef struct
+{
+    uint32_t lock;
+    uint8_t  meta;       // STK_ENTRY_META1_*
+    uint64_t uid;
+} gen_row;
+
+typedef struct
+{
+    uint32_t lock;
+    uint32_t firstRow;
+    uint32_t numRows;
+} gen_lock;
+
+typedef struct
+{
+    const gen_row  *rows;
+    const gen_lock *locks;
+    uint32_t numLocks;
+    uint32_t next;       // Next unclaimed lock, taken GEN_BATCH at a time
+    const char *outDir;  // One file per lock, or
+    int      archiveFd;  // the archive, -1 = neither (--bench)
+    uint32_t dataOfs;    // Of the first image in the archive
+    uint16_t *crcs;      // op_mode.crc of each image, for --check
+    uint32_t errors;
+} gen_job;
+
+typedef struct
+{
+    pthread_t thread;
+    gen_job  *job;
+    stk_onflash_data ofd; // The worker's image buffer
+} gen_worker;
+
+
+static int genCmpRow(const void *a, const void *b);
+
+
+//------------------------------------------------
+//                  IMAGES
+//------------------------------------------------
+// Fill in ofd for one lock.  Returns false (and says why) if it does not fit.
+static bool genImage(const gen_job *job, const gen_lock *lk, stk_onflash_data *ofd)
+{
+    uint32_t lnum = 0;
+    uint32_t r = 0;
+
+    memset((uint8_t *)ofd, 0, sizeof(*ofd));
+
+    for (r = 0; r < lk->numRows; r++) {
+        const gen_row *lrow = &job->rows[lk->firstRow + r];
+
+        // The same line twice
+        if ( (r > 0) && (genCmpRow(lrow, lrow - 1) == 0) ) {
+            continue;
+        }
+
+        if (lrow->meta & STK_ENTRY_META1_ISMASTER) {
+            if (ofd->master1.uid != 0) {
+                fprintf(stderr, "lock %u: more than one master\n", lk->lock);
+                return false;
+            }
+            ofd->master1.uid = lrow->uid;
+            ofd->master1.meta1_truST25_mast = lrow->meta;
+            continue;
+        }
+        if (lnum == STK_ONFLASH_ENTRIES) {
+            fprintf(stderr, "lock %u: more than %d stickers\n", lk->lock, STK_ONFLASH_ENTRIES);
+            return false;
+        }
+        ofd->entries[lnum].uid = lrow->uid;
+        ofd->entries[lnum].meta1_truST25_mast = lrow->meta;
+        lnum++;
+    }
+
+    stk_ofdSeal(ofd);
+    return true;
+}
+
+static bool genWrite(const gen_job *job, uint32_t i, const stk_onflash_data *ofd)
+{
+    char  lpath[4096];
+    FILE *f = NULL;
+    bool  lok = false;
+
+    if (job->archiveFd >= 0) {
+        off_t lofs = (off_t)job->dataOfs + ((off_t)i * STK_ONFLASH_DATA_LEN);
+        return pwrite(job->archiveFd, ofd, STK_ONFLASH_DATA_LEN, lofs) == STK_ONFLASH_DATA_LEN;
+    }
+    if (job->outDir == NULL) {
+        return true;
+    }
+
+    snprintf(lpath, sizeof(lpath), "%s/%u.ofd", job->outDir, job->locks[i].lock);
+    f = fopen(lpath, "wb");
+    if (f == NULL) {
+        fprintf(stderr, "%s: cannot create\n", lpath);
+        return false;
+    }
+    lok = fwrite(ofd, 1, STK_ONFLASH_DATA_LEN, f) == STK_ONFLASH_DATA_LEN;
+    lok = (fclose(f) == 0) && lok;
+    return lok;
+}
+
+static void *genWorker(void *arg)
+{
+    gen_worker *w = (gen_worker *)arg;
+    gen_job    *job = w->job;
+    uint32_t    lfirst = 0;
+    uint32_t    i = 0;
+
+    while ((lfirst = __atomic_fetch_add(&job->next, GEN_BATCH, __ATOMIC_RELAXED)) < job->numLocks) {
+        uint32_t lend = lfirst + GEN_BATCH;
+        if (lend > job->numLocks) {
+            lend = job->numLocks;
+        }
+
+        for (i = lfirst; i < lend; i++) {
+            if ( !genImage(job, &job->locks[i], &w->ofd) ||
+                 !genWrite(job, i, &w->ofd) )
+            {
+                __atomic_fetch_add(&job->errors, 1, __ATOMIC_RELAXED);
+                continue;
+            }
+            job->crcs[i] = w->ofd.op_mode.crc;
+        }
+    }
+    return NULL;
+}
+
+// All images of job with numThreads workers.  Returns the number that failed.
+static uint32_t genRun(gen_job *job, gen_worker *workers, int numThreads)
+{
+    int t = 0;
+
+    job->next   = 0;
+    job->errors = 0;
+
+    for (t = 0; t < numThreads; t++) {
+        workers[t].job = job;
+        if (pthread_create(&workers[t].thread, NULL, genWorker, &workers[t]) != 0) {
+            fprintf(stderr, "cannot start thread %d\n", t);
+            numThreads = t;
+            job->errors++;
+            break;
+        }
+    }
+    for (t = 0; t < numThreads; t++) {
+        pthread_join(workers[t].thread, NULL);
+    }
+    return job->errors;
+}
+
+
+//------------------------------------------------
+//                ACCESS MATRIX
+//------------------------------------------------
+static int genCmpRow(const void *a, const void *b)
+{
+    const gen_row *x = (const gen_row *)a;
+    const gen_row *y = (const gen_row *)b;
+
+    if (x->lock != y->lock) {
+        return (x->lock > y->lock) ? 1 : -1;
+    }
+    if (x->uid != y->uid) {
+        return (x->uid > y->uid) ? 1 : -1;
+    }
+    return (int)x->meta - (int)y->meta;
+}
+
+// Sort rows by lock and UID (so the images do not depend on line order) and
+// build locks[].  Returns the number of locks.
+static uint32_t genGroup(gen_row *rows, uint32_t numRows, gen_lock **locks)
+{
+    uint32_t lnum = 0;
+    uint32_t r = 0;
+
+    qsort(rows, numRows, sizeof(gen_row), genCmpRow);
+    *locks = calloc((numRows > 0) ? numRows : 1, sizeof(gen_lock));
+    if (*locks == NULL) {
+        return 0;
+    }
+
+    for (r = 0; r < numRows; r++) {
+        if ( (lnum == 0) || ((*locks)[lnum - 1].lock != rows[r].lock) ) {
+            (*locks)[lnum].lock     = rows[r].lock;
+            (*locks)[lnum].firstRow = r;
+            lnum++;
+        }
+        (*locks)[lnum - 1].numRows++;
+    }
+    return lnum;
+}
+
+static gen_row *genParse(const char *path, uint32_t *numRows)
+{
+    FILE    *f = fopen(path, "r");
+    gen_row *lrows = NULL;
+    uint32_t lcap = 0;
+    uint32_t lnum = 0;
+    uint32_t lline = 0;
+    char     lbuf[256];
+
+    if (f == NULL) {
+        fprintf(stderr, "%s: cannot open\n", path);
+        return NULL;
+    }
+
+    while (fgets(lbuf, sizeof(lbuf), f) != NULL) {
+        char *p = lbuf;
+        char *lend = NULL;
+        gen_row lrow;
+
+        lline++;
+        while ((*p == ' ') || (*p == '\t')) {
+            p++;
+        }
+        if ((*p == '#') || (*p == '\n') || (*p == '\r') || (*p == '\0')) {
+            continue;
+        }
+
+        memset((uint8_t *)&lrow, 0, sizeof(lrow));
+        errno = 0;
+        lrow.lock = (uint32_t)strtoul(p, &lend, 10);
+        if ((lend == p) || (*lend != ',') || (errno != 0)) {
+            fprintf(stderr, "%s:%u: bad lock\n", path, lline);
+            goto fail;
+        }
+        p = lend + 1;
+        lrow.uid = strtoull(p, &lend, 16);
+        if ((lend == p) || (lrow.uid == 0) || (errno != 0)) {
+            fprintf(stderr, "%s:%u: bad uid\n", path, lline);
+            goto fail;
+        }
+        for (p = lend; (*p != '\0') && (*p != '\n') && (*p != '#'); p++) {
+            if (*p == 'm') {
+                lrow.meta |= STK_ENTRY_META1_ISMASTER;
+            } else if (*p == 't') {
+                lrow.meta |= STK_ENTRY_META1_ISTRUST25;
+            } else if ((*p != ',') && (*p != ' ') && (*p != '\t') && (*p != '\r')) {
+                fprintf(stderr, "%s:%u: bad flag '%c'\n", path, lline, *p);
+                goto fail;
+            }
+        }
+
+        if (lnum == lcap) {
+            gen_row *lgrown = NULL;
+            lcap = (lcap == 0) ? 1024 : (lcap * 2);
+            lgrown = realloc(lrows, lcap * sizeof(gen_row));
+            if (lgrown == NULL) {
+                fprintf(stderr, "out of memory\n");
+                goto fail;
+            }
+            lrows = lgrown;
+        }
+        lrows[lnum++] = lrow;
+    }
+
+    fclose(f);
+    *numRows = lnum;
+    return (lrows != NULL) ? lrows : calloc(1, sizeof(gen_row));
+
+fail:
+    fclose(f);
+    free(lrows);
+    return NULL;
+}
+
+// Header and index; the images follow at job->dataOfs
+static bool genArchiveBegin(gen_job *job, const char *path)
+{
+    gen_archive_hdr lhdr;
+    uint32_t i = 0;
+
+    job->archiveFd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (job->archiveFd < 0) {
+        fprintf(stderr, "%s: cannot create\n", path);
+        return false;
+    }
+
+    lhdr.magic    = GEN_ARCHIVE_MAGIC;
+    lhdr.version  = GEN_ARCHIVE_VERSION;
+    lhdr.imageLen = STK_ONFLASH_DATA_LEN;
+    lhdr.numLocks = job->numLocks;
+    job->dataOfs  = sizeof(lhdr) + (job->numLocks * sizeof(gen_archive_idx));
+    if (write(job->archiveFd, &lhdr, sizeof(lhdr)) != (ssize_t)sizeof(lhdr)) {
+        return false;
+    }
+
+    for (i = 0; i < job->numLocks; i++) {
+        gen_archive_idx lidx;
+        lidx.lock   = job->locks[i].lock;
+        lidx.offset = job->dataOfs + (i * STK_ONFLASH_DATA_LEN);
+        if (write(job->archiveFd, &lidx, sizeof(lidx)) != (ssize_t)sizeof(lidx)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+//------------------------------------------------
+//                  BENCHMARK
+//------------------------------------------------
+static uint64_t gGenRnd = 0x5EEDF00DULL;
+
+static uint64_t genRand(void)
+{
+    gGenRnd ^= gGenRnd << 13;
+    gGenRnd ^= gGenRnd >> 7;
+    gGenRnd ^= gGenRnd << 17;
+    return gGenRnd;
+}
+
+// numLocks locks of 150 stickers from a pool of 5000 users, plus a master
+static gen_row *genFleet(uint32_t numLocks, uint32_t *numRows)
+{
+    uint32_t lper = 151;
+    gen_row *lrows = calloc((size_t)numLocks * lper, sizeof(gen_row));
+    uint32_t l = 0;
+    uint32_t k = 0;
+
+    if (lrows == NULL) {
+        return NULL;
+    }
+    for (l = 0; l < numLocks; l++) {
+        for (k = 0; k < lper; k++) {
+            gen_row *lrow = &lrows[(l * lper) + k];
+            lrow->lock = l + 1;
+            lrow->uid  = 0xE002000000000000ULL | ((genRand() % 5000) + 1);
+            lrow->meta = (k == 0) ? STK_ENTRY_META1_ISMASTER : ((k % 8) == 0) ? STK_ENTRY_META1_ISTRUST25 : 0;
+            if (k == 0) {
+                lrow->uid |= 0x0000100000000000ULL; // Masters are not users
+            }
+        }
+    }
+    *numRows = numLocks * lper;
+    return lrows;
+}
+
+static int genBench(uint32_t numLocks, bool check, int maxThreads, gen_worker *workers)
+{
+    uint32_t lnumRows = 0;
+    gen_row *lrows = genFleet(numLocks, &lnumRows);
+    gen_lock *llocks = NULL;
+    uint16_t *lref = NULL;
+    gen_job  ljob;
+    long     lcores = maxThreads;
+    int      lthreads = 1;
+    int      lret = 0;
+
+    memset((uint8_t *)&ljob, 0, sizeof(ljob));
+    if (lrows == NULL) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    ljob.rows      = lrows;
+    ljob.numLocks  = genGroup(lrows, lnumRows, &llocks);
+    ljob.locks     = llocks;
+    ljob.archiveFd = -1;
+    ljob.crcs      = calloc(numLocks, sizeof(uint16_t));
+    lref           = calloc(numLocks, sizeof(uint16_t));
+    if ((llocks == NULL) || (ljob.crcs == NULL) || (lref == NULL)) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    if (lcores < 1) {
+        lcores = 1;
+    } else if (lcores > GEN_MAX_THREADS) {
+        lcores = GEN_MAX_THREADS;
+    }
+
+    for (lthreads = 1; ; lthreads *= 2) {
+        char     lname[64];
+        uint64_t t = 0;
+        double   ls = 0;
+
+        if (lthreads > lcores) {
+            lthreads = (int)lcores;
+        }
+
+        t = stk_hostNowNs();
+        lret |= (genRun(&ljob, workers, lthreads) != 0);
+        ls = (double)(stk_hostNowNs() - t) / 1e9;
+
+        snprintf(lname, sizeof(lname), "gen.images_per_sec.threads%d", lthreads);
+        printf("{\"metric\":\"%s\",\"value\":%.0f,\"unit\":\"images/s\"}\n", lname, numLocks / ls);
+
+        if (lthreads == 1) {
+            memcpy(lref, ljob.crcs, numLocks * sizeof(uint16_t));
+        } else if (check && (memcmp(lref, ljob.crcs, numLocks * sizeof(uint16_t)) != 0)) {
+            fprintf(stderr, "FAIL: %d threads made different images\n", lthreads);
+            lret = 1;
+        }
+        if (lthreads >= lcores) {
+            break;
+        }
+    }
+
+    free(lref);
+    free(ljob.crcs);
+    free(llocks);
+    free(lrows);
+    return lret;
+}
+
+
+int main(int argc, char **argv)
+{
+    static gen_worker lworkers[GEN_MAX_THREADS];
+    const char *lmatrix = NULL;
+    const char *lout = NULL;
+    const char *larchive = NULL;
+    uint32_t lbenchLocks = 0;
+    uint32_t lnumRows = 0;
+    gen_row  *lrows = NULL;
+    gen_lock *llocks = NULL;
+    gen_job   ljob;
+    bool lcheck = false;
+    int  lthreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    int  i = 0;
+
+    for (i = 1; i < argc; i++) {
+        if ( (strcmp(argv[i], "-j") == 0) && ((i + 1) < argc) ) {
+            lthreads = atoi(argv[++i]);
+        } else if ( (strcmp(argv[i], "--out") == 0) && ((i + 1) < argc) ) {
+            lout = argv[++i];
+        } else if ( (strcmp(argv[i], "--archive") == 0) && ((i + 1) < argc) ) {
+            larchive = argv[++i];
+        } else if (strcmp(argv[i], "--bench") == 0) {
+            lbenchLocks = 10000;
+            if ( ((i + 1) < argc) && (argv[i + 1][0] != '-') ) {
+                lbenchLocks = (uint32_t)strtoul(argv[++i], NULL, 10);
+            }
+        } else if (strcmp(argv[i], "--check") == 0) {
+            lcheck = true;
+        } else if (lmatrix == NULL) {
+            lmatrix = argv[i];
+        } else {
+            lmatrix = NULL;
+            break;
+        }
+    }
+    if (lthreads < 1) {
+        lthreads = 1;
+    } else if (lthreads > GEN_MAX_THREADS) {
+        lthreads = GEN_MAX_THREADS;
+    }
+
+    if (lbenchLocks > 0) {
+        return genBench(lbenchLocks, lcheck, lthreads, lworkers);
+    }
+    if ( (lmatrix == NULL) || ((lout == NULL) == (larchive == NULL)) ) {
+        fprintf(stderr, "usage: %s [-j THREADS] (--out DIR | --archive FILE) MATRIX.csv\n"
+                        "       %s --bench [LOCKS] [--check]\n", argv[0], argv[0]);
+        return 2;
+    }
+
+    lrows = genParse(lmatrix, &lnumRows);
+    if (lrows == NULL) {
+        return 1;
+    }
+
+    memset((uint8_t *)&ljob, 0, sizeof(ljob));
+    ljob.rows      = lrows;
+    ljob.numLocks  = genGroup(lrows, lnumRows, &llocks);
+    ljob.locks     = llocks;
+    ljob.outDir    = lout;
+    ljob.archiveFd = -1;
+    ljob.crcs      = calloc((ljob.numLocks > 0) ? ljob.numLocks : 1, sizeof(uint16_t));
+    if ((llocks == NULL) || (ljob.crcs == NULL)) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    if ( (larchive != NULL) && !genArchiveBegin(&ljob, larchive) ) {
+        return 1;
+    }
+
+    genRun(&ljob, lworkers, lthreads);
+    if ( (ljob.archiveFd >= 0) && (close(ljob.archiveFd) != 0) ) {
+        ljob.errors++;
+    }
+    fprintf(stderr, "%u locks, %u failed\n", ljob.numLocks, ljob.errors);
+
+    free(ljob.crcs);
+    free(llocks);
+    free(lrows);
+    return (ljob.errors != 0) ? 1 : 0;
+}
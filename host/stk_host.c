@@ -0,0 +1,372 @@
+//------------------------------------------------
+// Copyright (c) 2022 stickLabs.io  All rights reserved.
+//------------------------------------------------
+
+#define _POSIX_C_SOURCE 199309L
+#include <stdio.h>
+#include <stdarg.h>
+#include <time.h>
+
+#include "stk_host.h"
+#include "stickLabs.h"  // stk_dbEntry
+
+extern stk_dbEntry *gSRF;
+
+stk_host_tag      gStkHostTag[STK_HOST_MAX_TAGS];
+stk_host_rf_stats gStkHostRf;
+
+uint32_t gStkHostEeprom[STK_HOST_EEPROM_WORDS];
+uint32_t gStkHostEepromWrites;
+uint16_t gStkHostEepromBad;
+uint32_t gStkHostRtc;
+bool     gStkHostWallClock;
+bool     gStkHostVerbose;
+
+static uint8_t gStkHostLogFlash[STK_HOST_LOG_BYTES];
+
+
+//------------------------------------------------
+//                  PLATFORM
+//------------------------------------------------
+void stk_hostLog(const char *fmt, ...)
+{
+    va_list ap;
+
+    if (!gStkHostVerbose) {
+        return;
+    }
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+}
+
+uint64_t stk_hostNowNs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000000ULL) + (uint64_t)ts.tv_nsec;
+}
+
+uint32_t stk_cycleCount(void)
+{
+    return (uint32_t)((stk_hostNowNs() * STK_HOST_MHZ) / 1000U);
+}
+
+uint32_t stk_rtcGetSeconds(void)
+{
+    return gStkHostRtc;
+}
+
+bool stk_rtcGetHourOfDay(uint8_t *hour)
+{
+    *hour = (uint8_t)((gStkHostRtc / 3600U) % 24U);
+    return gStkHostWallClock;
+}
+
+bool stk_eepromWrite32(uint16_t virtAddr, uint32_t data)
+{
+    if ( (virtAddr == 0) || (virtAddr >= STK_HOST_EEPROM_WORDS) || (virtAddr == gStkHostEepromBad) ) {
+        return false;
+    }
+    gStkHostEeprom[virtAddr] = data;
+    gStkHostEepromWrites++;
+    return true;
+}
+
+bool stk_eepromRead32(uint16_t virtAddr, uint32_t *data)
+{
+    if ( (virtAddr == 0) || (virtAddr >= STK_HOST_EEPROM_WORDS) || (virtAddr == gStkHostEepromBad) ) {
+        return false;
+    }
+    *data = gStkHostEeprom[virtAddr];
+    return true;
+}
+
+bool stk_logFlashErase(uint16_t sector)
+{
+    if ((((uint32_t)sector + 1) * STK_HOST_LOG_SECTOR) > STK_HOST_LOG_BYTES) {
+        return false;
+    }
+    memset(&gStkHostLogFlash[(uint32_t)sector * STK_HOST_LOG_SECTOR], 0xFF, STK_HOST_LOG_SECTOR);
+    return true;
+}
+
+// Like NOR flash, programming can only clear bits
+bool stk_logFlashWrite(uint32_t offset, const uint8_t *data, uint16_t len)
+{
+    uint16_t i = 0;
+
+    if ((offset + len) > STK_HOST_LOG_BYTES) {
+        return false;
+    }
+    for (i = 0; i < len; i++) {
+        gStkHostLogFlash[offset + i] &= data[i];
+    }
+    return true;
+}
+
+bool stk_logFlashRead(uint32_t offset, uint8_t *data, uint16_t len)
+{
+    if ((offset + len) > STK_HOST_LOG_BYTES) {
+        return false;
+    }
+    memcpy(data, &gStkHostLogFlash[offset], len);
+    return true;
+}
+
+
+//------------------------------------------------
+//            APPLICATION (out of tree)
+//------------------------------------------------
+static uint64_t stk_hostDevUid(const rfalNfcDevice *nfcDev)
+{
+    uint64_t luid = 0;
+
+    if ( (nfcDev == NULL) || (nfcDev->nfcid == NULL) || (nfcDev->nfcidLen != RFAL_NFCV_UID_LEN) ) {
+        return 0;
+    }
+    memcpy((uint8_t *)&luid, nfcDev->nfcid, RFAL_NFCV_UID_LEN);
+    return luid;
+}
+
+// The TruST25 signature read is modelled as one more RF command
+bool isTheSame(rfalNfcDevice *nfcDev, bool truST25, int idx, int i)
+{
+    stk_dbEntry *lent = &gSRF[idx + i];
+
+    if (truST25 && (lent->meta1_truST25_mast & STK_HOST_META1_ISTRUST25)) {
+        gStkHostRf.truST25++;
+        gStkHostRf.cmds++;
+        // Addressed Read Signature (IC manufacturer code), 32 byte signature back
+        gStkHostRf.airUs += stk_hostRfFrameUs(2 + RFAL_NFCV_UID_LEN + 1 + RFAL_CRC_LEN,
+                                              1 + 32 + RFAL_CRC_LEN);
+    }
+    return (lent->uid != 0) && (lent->uid == stk_hostDevUid(nfcDev));
+}
+
+uint64_t stk_nfcDev_or_backupStk(rfalNfcDevice *nfcDev, void *dat)
+{
+    const uint8_t *ldat = (const uint8_t *)dat;
+    uint64_t luid = 0;
+
+    if ( (ldat != NULL) && (ldat[1] == STK_HOST_FUNC_BACKUP) ) {
+        memcpy((uint8_t *)&luid, &ldat[STK_HOST_BACKUP_UID_OFS], RFAL_NFCV_UID_LEN);
+        return luid;
+    }
+    return stk_hostDevUid(nfcDev);
+}
+
+void stk_writeToRamFlash_uid(uint64_t uid, bool truST25, bool isMaster, int idx, int i)
+{
+    stk_dbEntry lent;
+
+    memset((uint8_t *)&lent, 0, sizeof(lent));
+    lent.meta1_truST25_mast = (truST25  ? STK_HOST_META1_ISTRUST25 : 0U) |
+                              (isMaster ? STK_HOST_META1_ISMASTER  : 0U);
+    lent.uid = uid;
+    gSRF[idx + i] = lent;
+}
+
+void stk_writeToRamFlash_ent(void *ent, int idx, int i)
+{
+    memcpy((uint8_t *)&gSRF[idx + i], (uint8_t *)ent, sizeof(stk_dbEntry));
+}
+
+
+//------------------------------------------------
+//                 RF FIELD
+//------------------------------------------------
+
+// ISO15693-2 timings, rounded to us
+#define STK_HOST_REQ_BYTE_US    (302)  // 1 out of 4: 4 x 75.52
+#define STK_HOST_REQ_SOF_EOF_US (113)
+#define STK_HOST_REQ_EOF_US     (38)   // Alone: the next inventory slot
+#define STK_HOST_RESP_BYTE_US   (151)  // High rate, one subcarrier: 8 x 18.88
+#define STK_HOST_RESP_SOF_EOF_US (94)
+#define STK_HOST_T1_US          (321)  // Request EOF to response SOF
+#define STK_HOST_T2_US          (309)  // Response EOF to the next request
+#define STK_HOST_SLOT_EMPTY_US  (361)  // Inventory slot nobody answers: EOF + t3
+#define STK_HOST_INV_SLOTS      (16)
+
+// Request: flags, command, [UID], parameters, CRC
+#define STK_HOST_REQ_LEN(addressed, params) (2 + ((addressed) ? RFAL_NFCV_UID_LEN : 0) + (params) + RFAL_CRC_LEN)
+
+uint32_t stk_hostRfFrameUs(uint32_t reqBytes, uint32_t respBytes)
+{
+    uint32_t lus = STK_HOST_REQ_SOF_EOF_US + (reqBytes * STK_HOST_REQ_BYTE_US) + STK_HOST_T1_US;
+
+    if (respBytes > 0) {
+        lus += STK_HOST_RESP_SOF_EOF_US + (respBytes * STK_HOST_RESP_BYTE_US);
+    }
+    return lus + STK_HOST_T2_US;
+}
+
+void stk_hostFieldClear(void)
+{
+    int i = 0;
+
+    for (i = 0; i < STK_HOST_MAX_TAGS; i++) {
+        gStkHostTag[i].present = false;
+    }
+}
+
+stk_host_tag *stk_hostTagAdd(uint64_t uid)
+{
+    int i = 0;
+
+    for (i = 0; i < STK_HOST_MAX_TAGS; i++) {
+        stk_host_tag *ltag = &gStkHostTag[i];
+        if (!ltag->present) {
+            memset((uint8_t *)ltag, 0, sizeof(*ltag));
+            memcpy(ltag->uid, (uint8_t *)&uid, RFAL_NFCV_UID_LEN);
+            ltag->present   = true;
+            ltag->pullAfter = -1;
+            return ltag;
+        }
+    }
+    return NULL;
+}
+
+void stk_hostTagWrite(stk_host_tag *tag, uint16_t block, const void *data, uint32_t len)
+{
+    if (((uint32_t)block * 4U + len) <= sizeof(tag->mem)) {
+        memcpy(&tag->mem[(uint32_t)block * 4U], data, len);
+    }
+}
+
+void stk_hostNfcDev(stk_host_tag *tag, rfalNfcDevice *dev)
+{
+    memset((uint8_t *)dev, 0, sizeof(*dev));
+    dev->type = RFAL_NFC_LISTEN_TYPE_NFCV;
+    memcpy(dev->dev.nfcv.InvRes.UID, tag->uid, RFAL_NFCV_UID_LEN);
+    dev->nfcid    = tag->uid;
+    dev->nfcidLen = RFAL_NFCV_UID_LEN;
+}
+
+// The tag that answers a read, NULL if none or *collision
+static stk_host_tag *stk_hostReadTarget(const uint8_t *uid, bool *collision)
+{
+    stk_host_tag *lfound = NULL;
+    int lanswers = 0;
+    int i = 0;
+
+    gStkHostRf.cmds++;
+    *collision = false;
+
+    for (i = 0; i < STK_HOST_MAX_TAGS; i++) {
+        stk_host_tag *ltag = &gStkHostTag[i];
+        if (!ltag->present || ltag->mute || (ltag->pullAfter == 0)) {
+            continue;
+        }
+        if ( (uid == NULL) || (memcmp(ltag->uid, uid, RFAL_NFCV_UID_LEN) == 0) ) {
+            lfound = ltag;
+            lanswers++;
+        }
+    }
+
+    if (lanswers > 1) {
+        gStkHostRf.collisions++;
+        *collision = true;
+        return NULL;
+    }
+    if ( (lfound != NULL) && (lfound->pullAfter > 0) ) {
+        lfound->pullAfter--;
+    }
+    return lfound;
+}
+
+// params: the request's block number and count bytes
+static ReturnCode stk_hostRead(const uint8_t *uid, uint32_t params, uint16_t first, uint16_t num,
+                               uint8_t *rxBuf, uint16_t rxBufLen, uint16_t *rcvLen)
+{
+    bool lcollision = false;
+    stk_host_tag *ltag = stk_hostReadTarget(uid, &lcollision);
+    uint32_t lreq = STK_HOST_REQ_LEN(uid != NULL, params);
+
+    *rcvLen = 0;
+    if (ltag == NULL) {
+        // A collision is as long as the answer would have been
+        gStkHostRf.airUs += stk_hostRfFrameUs(lreq, lcollision ? (1U + (num * 4U) + RFAL_CRC_LEN) : 0);
+        return lcollision ? ERR_RF_COLLISION : ERR_TIMEOUT;
+    }
+    if ( ((uint32_t)(first + num) > STK_HOST_TAG_BLOCKS) ||
+         ((1U + (num * 4U) + RFAL_CRC_LEN) > rxBufLen) )
+    {
+        gStkHostRf.airUs += stk_hostRfFrameUs(lreq, 0);
+        return ERR_TIMEOUT;
+    }
+    gStkHostRf.airUs += stk_hostRfFrameUs(lreq, 1U + (num * 4U) + RFAL_CRC_LEN);
+
+    rxBuf[0] = 0; // Response flags
+    memcpy(&rxBuf[1], &ltag->mem[first * 4U], num * 4U);
+    *rcvLen = (uint16_t)(1U + (num * 4U)); // CRC not included
+    gStkHostRf.blocks += num;
+    return ERR_NONE;
+}
+
+ReturnCode rfalNfcvPollerReadSingleBlock(uint8_t flags, const uint8_t *uid, uint8_t blockNum,
+                                         uint8_t *rxBuf, uint16_t rxBufLen, uint16_t *rcvLen)
+{
+    gStkHostRf.rsb++;
+    return stk_hostRead(uid, 1, blockNum, 1, rxBuf, rxBufLen, rcvLen);
+}
+
+ReturnCode rfalNfcvPollerReadMultipleBlocks(uint8_t flags, const uint8_t *uid, uint8_t firstBlockNum,
+                                            uint8_t numOfBlocks, uint8_t *rxBuf, uint16_t rxBufLen,
+                                            uint16_t *rcvLen)
+{
+    gStkHostRf.rmb++;
+    return stk_hostRead(uid, 2, firstBlockNum, (uint16_t)(numOfBlocks + 1), rxBuf, rxBufLen, rcvLen);
+}
+
+ReturnCode rfalNfcvPollerExtendedReadMultipleBlocks(uint8_t flags, const uint8_t *uid, uint16_t firstBlockNum,
+                                                    uint16_t numOfBlocks, uint8_t *rxBuf, uint16_t rxBufLen,
+                                                    uint16_t *rcvLen)
+{
+    gStkHostRf.rmb++;
+    return stk_hostRead(uid, 4, firstBlockNum, (uint16_t)(numOfBlocks + 1), rxBuf, rxBufLen, rcvLen);
+}
+
+ReturnCode rfalNfcvPollerCollisionResolution(rfalComplianceMode compMode, uint8_t devLimit,
+                                             rfalNfcvListenDevice *nfcvDevList, uint8_t *devCnt)
+{
+    int i = 0;
+
+    gStkHostRf.cmds++;
+    gStkHostRf.inventories++;
+    *devCnt = 0;
+
+    for (i = 0; (i < STK_HOST_MAX_TAGS) && (*devCnt < devLimit); i++) {
+        if (gStkHostTag[i].present) {
+            rfalNfcvListenDevice *ldev = &nfcvDevList[*devCnt];
+            memset((uint8_t *)ldev, 0, sizeof(*ldev));
+            memcpy(ldev->InvRes.UID, gStkHostTag[i].uid, RFAL_NFCV_UID_LEN);
+            (*devCnt)++;
+        }
+    }
+
+    // One 16 slot round without slot collisions: the request (flags,
+    // command, mask length, CRC), one answer (flags, DSFID, UID, CRC) per
+    // tag, and the other slots empty
+    gStkHostRf.airUs += stk_hostRfFrameUs(5, (*devCnt > 0) ? 12 : 0) - STK_HOST_T2_US;
+    for (i = 1; i < *devCnt; i++) {
+        gStkHostRf.airUs += STK_HOST_REQ_EOF_US + STK_HOST_T1_US +
+                            STK_HOST_RESP_SOF_EOF_US + (12 * STK_HOST_RESP_BYTE_US);
+    }
+    gStkHostRf.airUs += ((STK_HOST_INV_SLOTS - ((*devCnt > 0) ? *devCnt : 1)) * STK_HOST_SLOT_EMPTY_US) + STK_HOST_T2_US;
+    return ERR_NONE;
+}
+
+
+void stk_hostReset(void)
+{
+    stk_hostFieldClear();
+    memset((uint8_t *)&gStkHostRf, 0, sizeof(gStkHostRf));
+    memset((uint8_t *)gStkHostEeprom, 0, sizeof(gStkHostEeprom));
+    memset(gStkHostLogFlash, 0xFF, sizeof(gStkHostLogFlash));
+    gStkHostEepromWrites = 0;
+    gStkHostEepromBad = 0;
+    gStkHostRtc = 0;
+    gStkHostWallClock = false;
+}
@@ -0,0 +1,79 @@
+//------------------------------------------------
+// Copyright (c) 2022 stickLabs.io  All rights reserved.
+//------------------------------------------------
+//
+// Host platform for stickLabs.c: the emulated EEPROM, RTC, cycle counter and
+// access log flash in RAM, and a simulated RF field of NFC-V tags behind the
+// stub RFAL in rfal_nfc.h.  Everything counts what it is asked to do, so
+// tests and benchmarks can report RF commands and EEPROM writes as well as
+// time.
+//
+
+#ifndef __STK_HOST_H__
+#define __STK_HOST_H__
+
+#include "rfal_nfc.h"
+
+#define STK_HOST_MHZ           (32)    // Target core clock, for stk_cycleCount()
+#define STK_HOST_MAX_TAGS      (4)
+#define STK_HOST_TAG_BLOCKS    (2048)  // ST25DV64K: a whole config payload fits
+#define STK_HOST_EEPROM_WORDS  (1024)  // Virtual addresses 1..1023
+#define STK_HOST_LOG_SECTOR    (2048)  // STK_LOG_SECTOR_LEN
+#define STK_HOST_LOG_BYTES     (64 * 1024)
+
+// Copies of stickLabs.c values the stubs need (its types are not in a
+// header); stk_bench.c checks they still match
+#define STK_HOST_META1_ISTRUST25  (0x01U) // STK_ENTRY_META1_ISTRUST25
+#define STK_HOST_META1_ISMASTER   (0x02U) // STK_ENTRY_META1_ISMASTER
+#define STK_HOST_FUNC_BACKUP      (10)    // STKFUNC_BACKUP_STICKER
+#define STK_HOST_BACKUP_UID_OFS   (4)     // stk_data.payload.fmat.UID
+
+typedef struct
+{
+    uint8_t  uid[RFAL_NFCV_UID_LEN];
+    uint8_t  mem[STK_HOST_TAG_BLOCKS * 4];
+    bool     present;
+    bool     mute;        // Answers the inventory, but no reads (e.g. a phone)
+    int32_t  pullAfter;   // Reads left before it leaves the field, -1 = stays
+} stk_host_tag;
+
+typedef struct
+{
+    uint32_t cmds;        // Every RFAL poller call
+    uint32_t rsb;         // Read Single Block
+    uint32_t rmb;         // Read Multiple Blocks (both forms)
+    uint32_t inventories;
+    uint32_t blocks;      // Blocks returned
+    uint32_t collisions;  // Unaddressed reads with more than one tag present
+    uint32_t truST25;     // isTheSame() calls that would do the TruST25 signature read
+    uint32_t airUs;       // Modelled air time of all of the above, see stk_hostRfFrameUs()
+} stk_host_rf_stats;
+
+extern stk_host_tag      gStkHostTag[STK_HOST_MAX_TAGS];
+extern stk_host_rf_stats gStkHostRf;
+
+extern uint32_t gStkHostEeprom[STK_HOST_EEPROM_WORDS];
+extern uint32_t gStkHostEepromWrites;
+extern uint16_t gStkHostEepromBad;  // Virtual address whose reads and writes fail, 0 = none
+extern uint32_t gStkHostRtc;        // stk_rtcGetSeconds()
+extern bool     gStkHostWallClock;  // stk_rtcGetHourOfDay() works, hour = (rtc / 3600) % 24
+extern bool     gStkHostVerbose;    // platformLog() to stderr
+
+void stk_hostReset(void);           // Empty field, blank EEPROM and log flash, zero counters
+
+// Tags in the field.  stk_hostTagAdd() returns the tag (memory zeroed).
+stk_host_tag *stk_hostTagAdd(uint64_t uid);
+void stk_hostFieldClear(void);
+void stk_hostTagWrite(stk_host_tag *tag, uint16_t block, const void *data, uint32_t len);
+
+// The rfalNfcDevice the RFAL would hand over for a tag
+void stk_hostNfcDev(stk_host_tag *tag, rfalNfcDevice *dev);
+
+// Air time of one ISO15693 exchange at the high data rate (1 out of 4 coding
+// from the reader, one subcarrier back): reqBytes and respBytes include flags
+// and CRC, respBytes 0 is a request nobody answers.  Turnarounds included.
+uint32_t stk_hostRfFrameUs(uint32_t reqBytes, uint32_t respBytes);
+
+uint64_t stk_hostNowNs(void);
+
+#endif // __STK_HOST_H__
@@ -15,6 +15,13 @@
                                   // bytes (but all 7 bytes (CRC) are actually
                                   // there.
 
+// Read Multiple Blocks: blocks per command and retries per chunk.  The
+// response (flags + data + CRC) has to fit one RFAL receive buffer, so this
+// stays well under the ST25TV limit.
+#define NFCV_RMB_MAX_BLOCKS  (32)
+#define NFCV_RMB_BUF_LEN     (1 + (NFCV_RMB_MAX_BLOCKS * NFCV_BLOCK_LEN) + RFAL_CRC_LEN)
+#define NFCV_RMB_RETRIES     (3)
+
 // WHY_START_AT_BLOCK_1 ?
 #define STK_DATA_START_OFFSET (4) // Offset in bytes verses start block below
 #define STK_DATA_START_BLOCK  (1) // Start at block 1 because this allows the flexibility to:
@@ -48,70 +55,91 @@
 
 // NOTE: Always add to the end!
 //       Or edit a placeholder
+//
+// Every sticker function, in stk_function order.  This one list generates the
+// stk_function enum and gDataSizeArray (name and on-sticker data size), so
+// they can't get out of step and looking a function up is a direct index.
+//
+//     X(function, size)
+//
+#define STK_FUNCTION_TABLE(X) \
+    X(STKFUNC_UNDEFINED,                       STK_DAT_ALWAYS_LEN) \
+    X(PLACEHOLDER_A,                           STK_DAT_ALWAYS_LEN) \
+    X(PLACEHOLDER_B,                           STK_DAT_ALWAYS_LEN) \
+    X(PLACEHOLDER_C,                           STK_DAT_ALWAYS_LEN) \
+    X(PLACEHOLDER_D,                           STK_DAT_ALWAYS_LEN) \
+    X(STKFUNC_REGULAR,                         STK_DAT_ALWAYS_LEN) \
+    X(STKFUNC_MASTER,                          STK_DAT_ALWAYS_LEN) \
+    X(STKFUNC_ADD_STICKER,                     STK_DAT_ALWAYS_LEN) \
+    X(STKFUNC_REMOVE_STICKER,                  STK_DAT_ALWAYS_LEN) \
+    X(STKFUNC_FACTORY_RESET,                   STK_DAT_ALWAYS_LEN) \
+    X(STKFUNC_BACKUP_STICKER,                  STK_BACKUP_LENV2) \
+    X(PLACEHOLDER_E,                           STK_DAT_ALWAYS_LEN) \
+    X(PLACEHOLDER_F,                           STK_DAT_ALWAYS_LEN) \
+    X(PLACEHOLDER_G,                           STK_DAT_ALWAYS_LEN) \
+    X(PLACEHOLDER_H,                           STK_DAT_ALWAYS_LEN) \
+    X(PLACEHOLDER_I,                           STK_DAT_ALWAYS_LEN) \
+    X(PLACEHOLDER_J,                           STK_DAT_ALWAYS_LEN) \
+    X(PLACEHOLDER_K,                           STK_DAT_ALWAYS_LEN) \
+    X(PLACEHOLDER_L,                           STK_DAT_ALWAYS_LEN) \
+    X(STKFUNC_OPEN_1_HOUR,                     STK_DAT_ALWAYS_LEN) \
+    X(STKFUNC_OPEN_2_HOURS,                    STK_DAT_ALWAYS_LEN) \
+    X(STKFUNC_OPEN_4_HOURS,                    STK_DAT_ALWAYS_LEN) \
+    X(STKFUNC_OPEN_8_HOURS,                    STK_DAT_ALWAYS_LEN) \
+    X(STKFUNC_OPEN_12_HOURS,                   STK_DAT_ALWAYS_LEN) \
+    X(STKFUNC_OPEN_18_HOURS,                   STK_DAT_ALWAYS_LEN) \
+    X(STKFUNC_OPEN_24_HOURS,                   STK_DAT_ALWAYS_LEN) \
+    X(STKFUNC_CLOSE_NOW,                       STK_DAT_ALWAYS_LEN) \
+    X(PLACEHOLDER_M,                           STK_DAT_ALWAYS_LEN) \
+    X(PLACEHOLDER_N,                           STK_DAT_ALWAYS_LEN) \
+    X(PLACEHOLDER_O,                           STK_DAT_ALWAYS_LEN) \
+    X(PLACEHOLDER_P,                           STK_DAT_ALWAYS_LEN) \
+    X(PLACEHOLDER_Q,                           STK_DAT_ALWAYS_LEN) \
+    X(PLACEHOLDER_R,                           STK_DAT_ALWAYS_LEN) \
+    X(PLACEHOLDER_S,                           STK_DAT_ALWAYS_LEN) \
+    X(PLACEHOLDER_T,                           STK_DAT_ALWAYS_LEN) \
+    X(PLACEHOLDER_U,                           STK_DAT_ALWAYS_LEN) \
+    X(PLACEHOLDER_V,                           STK_DAT_ALWAYS_LEN) \
+    X(PLACEHOLDER_W,                           STK_DAT_ALWAYS_LEN) \
+    X(PLACEHOLDER_X,                           STK_DAT_ALWAYS_LEN) \
+    X(PLACEHOLDER_Y,                           STK_DAT_ALWAYS_LEN) \
+    X(STKFUNC_GET_BATTERY_LIFE,                STK_DAT_ALWAYS_LEN) \
+    X(STKFUNC_ONE_TIME_ACCESS,                 STK_DAT_ALWAYS_LEN) \
+    X(STKFUNC_CHANGE_TO_PARANOID_MODE_DEFAULT, STK_DAT_ALWAYS_LEN) \
+    X(STKFUNC_CHANGE_TO_ALWAYS_OPEN_MODE,      STK_DAT_ALWAYS_LEN) \
+    X(STKFUNC_GET_ACCESS_LOGS,                 STK_DAT_ALWAYS_LEN) \
+    X(STKFUNC_GET_DEBUG_INFO,                  STK_DAT_ALWAYS_LEN) \
+    X(STKFUNC_VERIFY_BACKUP_STICKER,           STK_DAT_ALWAYS_LEN) \
+    /* Don't do this, we don't want production firmware to be able to write to */ \
+    /* stickers!   STKFUNC_CREATE_BACKUP_STICKER */ \
+    X(STKFUNC_COPY_CONFIG,                     STK_DAT_ALWAYS_LEN) \
+    X(STKFUNC_PASTE_CONFIG,                    STK_DAT_ALWAYS_LEN) \
+    X(STKFUNC_DO_TESTING_FUNCTION,             STK_DAT_ALWAYS_LEN) \
+    X(STKFUNC_SET_UNLOCK_TIME_10SEC,           STK_DAT_ALWAYS_LEN) \
+    X(STKFUNC_SET_UNLOCK_TIME_20SEC,           STK_DAT_ALWAYS_LEN) \
+    X(STKFUNC_CONFIG_PAYLOAD,                  STK_DAT_ALWAYS_LEN) \
+    X(STKFUNC_HWTUNE_MORE_CAP_SENSITIVITY,     STK_DAT_ALWAYS_LEN) /* Intended for factory use only */ \
+    X(STKFUNC_HWTUNE_LESS_CAP_SENSITIVITY,     STK_DAT_ALWAYS_LEN) /* Intended for factory use only */ \
+    X(STKFUNC_HWTUNE_GET_CAP_SENSITIVITY,      STK_DAT_ALWAYS_LEN) /* Intended for factory use only */ \
+    X(STKFUNC_CONFIG_DELTA_PAYLOAD,            STK_DAT_ALWAYS_LEN) \
+    X(STKFUNC_CONFIG_SPAN_PAYLOAD,             STK_DAT_ALWAYS_LEN)
+
+#define STK_FUNC_ENUM(function, size)  function,
 typedef enum
 {
-    STKFUNC_UNDEFINED = 0,
-    PLACEHOLDER_A,
-    PLACEHOLDER_B,
-    PLACEHOLDER_C,
-    PLACEHOLDER_D,
-    STKFUNC_REGULAR,
-    STKFUNC_MASTER,
-    STKFUNC_ADD_STICKER,
-    STKFUNC_REMOVE_STICKER,
-    STKFUNC_FACTORY_RESET,
-    STKFUNC_BACKUP_STICKER,
-    PLACEHOLDER_E,
-    PLACEHOLDER_F,
-    PLACEHOLDER_G,
-    PLACEHOLDER_H,
-    PLACEHOLDER_I,
-    PLACEHOLDER_J,
-    PLACEHOLDER_K,
-    PLACEHOLDER_L,
-    STKFUNC_OPEN_1_HOUR,
-    STKFUNC_OPEN_2_HOURS,
-    STKFUNC_OPEN_4_HOURS,
-    STKFUNC_OPEN_8_HOURS,
-    STKFUNC_OPEN_12_HOURS,
-    STKFUNC_OPEN_18_HOURS,
-    STKFUNC_OPEN_24_HOURS,
-    STKFUNC_CLOSE_NOW,
-    PLACEHOLDER_M,
-    PLACEHOLDER_N,
-    PLACEHOLDER_O,
-    PLACEHOLDER_P,
-    PLACEHOLDER_Q,
-    PLACEHOLDER_R,
-    PLACEHOLDER_S,
-    PLACEHOLDER_T,
-    PLACEHOLDER_U,
-    PLACEHOLDER_V,
-    PLACEHOLDER_W,
-    PLACEHOLDER_X,
-    PLACEHOLDER_Y,
-    STKFUNC_GET_BATTERY_LIFE,
-    STKFUNC_ONE_TIME_ACCESS,
-    STKFUNC_CHANGE_TO_PARANOID_MODE_DEFAULT,
-    STKFUNC_CHANGE_TO_ALWAYS_OPEN_MODE,
-    STKFUNC_GET_ACCESS_LOGS,
-    STKFUNC_GET_DEBUG_INFO,
-    STKFUNC_VERIFY_BACKUP_STICKER,
-    // Don't do this, we don't want production firmware to be able to write to
-    // stickers!   STKFUNC_CREATE_BACKUP_STICKER
-    STKFUNC_COPY_CONFIG,
-    STKFUNC_PASTE_CONFIG,
-    STKFUNC_DO_TESTING_FUNCTION,
-    STKFUNC_SET_UNLOCK_TIME_10SEC,
-    STKFUNC_SET_UNLOCK_TIME_20SEC,
-    STKFUNC_CONFIG_PAYLOAD,
-    STKFUNC_HWTUNE_MORE_CAP_SENSITIVITY, // Intended for factory use only
-    STKFUNC_HWTUNE_LESS_CAP_SENSITIVITY, // Intended for factory use only
-    STKFUNC_HWTUNE_GET_CAP_SENSITIVITY,  // Intended for factory use only
+    STK_FUNCTION_TABLE(STK_FUNC_ENUM)
 } stk_function;
 // NOTE: Always add to the end!
 //       Or edit a placeholder
 ct_assert(sizeof(stk_function)==1);
+// These values are written on stickers in the field and must never move
+ct_assert(STKFUNC_REGULAR==5);
+ct_assert(STKFUNC_BACKUP_STICKER==10);
+ct_assert(STKFUNC_OPEN_1_HOUR==19);
+ct_assert(STKFUNC_GET_BATTERY_LIFE==40);
+ct_assert(STKFUNC_CONFIG_PAYLOAD==52);
+ct_assert(STKFUNC_CONFIG_DELTA_PAYLOAD==56);
+ct_assert(STKFUNC_CONFIG_SPAN_PAYLOAD==57);
 
 typedef enum
 {
@@ -293,7 +321,7 @@ typedef struct __attribute__((__packed__))
     // This applies to the entire on-flash structure only
     // during Copy_Config, Paste_Config, and Config_Payload:
     uint16_t numBlks; // Number of valid STK_DB_ENTRY_SIZE blocks
-    uint16_t crc;
+    uint16_t crc;     // See stk_ramFlashCrc()
 
     uint8_t mode;
     uint8_t numWatchdogs;
@@ -376,129 +404,277 @@ ct_assert(sizeof(stk_onstick_config_payload)==(STK_ONSTICK_DATA_LEN+STK_ONFLASH_
 //------------------------------------------------
 //                   GLOBALS
 //------------------------------------------------
+#define STK_FUNC_SIZE_ROW(function, size)  [function] = { function, #function, size },
 const stk_data_size gDataSizeArray[] = {
-    { STKFUNC_UNDEFINED,
-     "STKFUNC_UNDEFINED",                        STK_DAT_ALWAYS_LEN },
-    { PLACEHOLDER_A,
-     "PLACEHOLDER_A",                            STK_DAT_ALWAYS_LEN },
-    { PLACEHOLDER_B,
-     "PLACEHOLDER_B",                            STK_DAT_ALWAYS_LEN },
-    { PLACEHOLDER_C,
-     "PLACEHOLDER_C",                            STK_DAT_ALWAYS_LEN },
-    { PLACEHOLDER_D,
-     "PLACEHOLDER_D",                            STK_DAT_ALWAYS_LEN },
-    { STKFUNC_REGULAR,
-     "STKFUNC_REGULAR",                          STK_DAT_ALWAYS_LEN },
-    { STKFUNC_MASTER,
-     "STKFUNC_MASTER",                           STK_DAT_ALWAYS_LEN },
-    { STKFUNC_ADD_STICKER,
-     "STKFUNC_ADD_STICKER",                      STK_DAT_ALWAYS_LEN },
-    { STKFUNC_REMOVE_STICKER,
-     "STKFUNC_REMOVE_STICKER",                   STK_DAT_ALWAYS_LEN },
-    { STKFUNC_FACTORY_RESET,
-     "STKFUNC_FACTORY_RESET",                    STK_DAT_ALWAYS_LEN },
-    { STKFUNC_BACKUP_STICKER,
-     "STKFUNC_BACKUP_STICKER",                   STK_BACKUP_LENV2 },
-    { PLACEHOLDER_E,
-     "PLACEHOLDER_E",                            STK_DAT_ALWAYS_LEN },
-    { PLACEHOLDER_F,
-     "PLACEHOLDER_F",                            STK_DAT_ALWAYS_LEN },
-    { PLACEHOLDER_G,
-     "PLACEHOLDER_G",                            STK_DAT_ALWAYS_LEN },
-    { PLACEHOLDER_H,
-     "PLACEHOLDER_H",                            STK_DAT_ALWAYS_LEN },
-    { PLACEHOLDER_I,
-     "PLACEHOLDER_I",                            STK_DAT_ALWAYS_LEN },
-    { PLACEHOLDER_J,
-     "PLACEHOLDER_J",                            STK_DAT_ALWAYS_LEN },
-    { PLACEHOLDER_K,
-     "PLACEHOLDER_K",                            STK_DAT_ALWAYS_LEN },
-    { PLACEHOLDER_L,
-     "PLACEHOLDER_L",                            STK_DAT_ALWAYS_LEN },
-    { STKFUNC_OPEN_1_HOUR,
-     "STKFUNC_OPEN_1_HOUR",                      STK_DAT_ALWAYS_LEN },
-    { STKFUNC_OPEN_2_HOURS,
-     "STKFUNC_OPEN_2_HOURS",                     STK_DAT_ALWAYS_LEN },
-    { STKFUNC_OPEN_4_HOURS,
-     "STKFUNC_OPEN_4_HOURS",                     STK_DAT_ALWAYS_LEN },
-    { STKFUNC_OPEN_8_HOURS,
-     "STKFUNC_OPEN_8_HOURS",                     STK_DAT_ALWAYS_LEN },
-    { STKFUNC_OPEN_12_HOURS,
-     "STKFUNC_OPEN_12_HOURS",                    STK_DAT_ALWAYS_LEN },
-    { STKFUNC_OPEN_18_HOURS,
-     "STKFUNC_OPEN_18_HOURS",                    STK_DAT_ALWAYS_LEN },
-    { STKFUNC_OPEN_24_HOURS,
-     "STKFUNC_OPEN_24_HOURS",                    STK_DAT_ALWAYS_LEN },
-    { STKFUNC_CLOSE_NOW,
-     "STKFUNC_CLOSE_NOW",                        STK_DAT_ALWAYS_LEN },
-    { PLACEHOLDER_M,
-     "PLACEHOLDER_M",                            STK_DAT_ALWAYS_LEN },
-    { PLACEHOLDER_N,
-     "PLACEHOLDER_N",                            STK_DAT_ALWAYS_LEN },
-    { PLACEHOLDER_O,
-     "PLACEHOLDER_O",                            STK_DAT_ALWAYS_LEN },
-    { PLACEHOLDER_P,
-     "PLACEHOLDER_P",                            STK_DAT_ALWAYS_LEN },
-    { PLACEHOLDER_Q,
-     "PLACEHOLDER_Q",                            STK_DAT_ALWAYS_LEN },
-    { PLACEHOLDER_R,
-     "PLACEHOLDER_R",                            STK_DAT_ALWAYS_LEN },
-    { PLACEHOLDER_S,
-     "PLACEHOLDER_S",                            STK_DAT_ALWAYS_LEN },
-    { PLACEHOLDER_T,
-     "PLACEHOLDER_T",                            STK_DAT_ALWAYS_LEN },
-    { PLACEHOLDER_U,
-     "PLACEHOLDER_U",                            STK_DAT_ALWAYS_LEN },
-    { PLACEHOLDER_V,
-     "PLACEHOLDER_V",                            STK_DAT_ALWAYS_LEN },
-    { PLACEHOLDER_W,
-     "PLACEHOLDER_W",                            STK_DAT_ALWAYS_LEN },
-    { PLACEHOLDER_X,
-     "PLACEHOLDER_X",                            STK_DAT_ALWAYS_LEN },
-    { PLACEHOLDER_Y,
-     "PLACEHOLDER_Y",                            STK_DAT_ALWAYS_LEN },
-    { STKFUNC_GET_BATTERY_LIFE,
-     "STKFUNC_GET_BATTERY_LIFE",                 STK_DAT_ALWAYS_LEN },
-    { STKFUNC_ONE_TIME_ACCESS,
-     "STKFUNC_ONE_TIME_ACCESS",                  STK_DAT_ALWAYS_LEN },
-    { STKFUNC_CHANGE_TO_PARANOID_MODE_DEFAULT,
-     "STKFUNC_CHANGE_TO_PARANOID_MODE_DEFAULT",  STK_DAT_ALWAYS_LEN },
-    { STKFUNC_CHANGE_TO_ALWAYS_OPEN_MODE,
-     "STKFUNC_CHANGE_TO_ALWAYS_OPEN_MODE",       STK_DAT_ALWAYS_LEN },
-    { STKFUNC_GET_ACCESS_LOGS,
-     "STKFUNC_GET_ACCESS_LOGS",                  STK_DAT_ALWAYS_LEN },
-    { STKFUNC_GET_DEBUG_INFO,
-     "STKFUNC_GET_DEBUG_INFO",                   STK_DAT_ALWAYS_LEN },
-    { STKFUNC_VERIFY_BACKUP_STICKER,
-     "STKFUNC_VERIFY_BACKUP_STICKER",            STK_DAT_ALWAYS_LEN },
-    { STKFUNC_COPY_CONFIG,
-     "STKFUNC_COPY_CONFIG",                      STK_DAT_ALWAYS_LEN },
-    { STKFUNC_PASTE_CONFIG,
-     "STKFUNC_PASTE_CONFIG",                     STK_DAT_ALWAYS_LEN },
-    { STKFUNC_DO_TESTING_FUNCTION,
-     "STKFUNC_DO_TESTING_FUNCTION",              STK_DAT_ALWAYS_LEN },
-    { STKFUNC_SET_UNLOCK_TIME_10SEC,
-     "STKFUNC_SET_UNLOCK_TIME_10SEC",            STK_DAT_ALWAYS_LEN },
-    { STKFUNC_SET_UNLOCK_TIME_20SEC,
-     "STKFUNC_SET_UNLOCK_TIME_20SEC",            STK_DAT_ALWAYS_LEN },
-    { STKFUNC_CONFIG_PAYLOAD,
-     "STKFUNC_CONFIG_PAYLOAD",                   STK_DAT_ALWAYS_LEN },
-    { STKFUNC_HWTUNE_MORE_CAP_SENSITIVITY,
-     "STKFUNC_HWTUNE_MORE_CAP_SENSITIVITY",      STK_DAT_ALWAYS_LEN },
-    { STKFUNC_HWTUNE_LESS_CAP_SENSITIVITY,
-     "STKFUNC_HWTUNE_LESS_CAP_SENSITIVITY",      STK_DAT_ALWAYS_LEN },
-    { STKFUNC_HWTUNE_GET_CAP_SENSITIVITY,
-     "STKFUNC_HWTUNE_GET_CAP_SENSITIVITY",       STK_DAT_ALWAYS_LEN },
+    STK_FUNCTION_TABLE(STK_FUNC_SIZE_ROW)
 };
-#define DAT_ARRAY_NUM_ELEMS  (56)
+#define STK_FUNC_COUNT(function, size)  + 1
+#define DAT_ARRAY_NUM_ELEMS  (0 STK_FUNCTION_TABLE(STK_FUNC_COUNT))
 ct_assert(sizeof(gDataSizeArray)/sizeof(stk_data_size)==DAT_ARRAY_NUM_ELEMS);
+ct_assert(DAT_ARRAY_NUM_ELEMS==(STKFUNC_CONFIG_SPAN_PAYLOAD + 1));
+
+// gDataSizeArray row for a function read off a sticker, NULL if this
+// firmware doesn't know it.  (Rows are indexed by function, no search.)
+static inline const stk_data_size *stk_funcInfo(stk_function function)
+{
+    if ((unsigned)function >= DAT_ARRAY_NUM_ELEMS) {
+        return NULL;
+    }
+    return &gDataSizeArray[function];
+}
 
-// start - These use a *lot* of our RAM!
+// This uses a *lot* of our RAM!
+// (Config payloads are streamed straight into it, see STREAMING PASTE)
 stk_onflash_data gStkRamFlash;
-stk_onstick_config_payload gStkConfigPayload;
-// end   - These use a *lot* of our RAM!
 
 stk_dbEntry *gSRF = (stk_dbEntry *)&gStkRamFlash;
+
+// UID index: slot numbers of every non-zero gStkRamFlash.entries[] sorted by
+// UID, so a lookup is a binary search (at most 9 compares) instead of a scan
+// of all STK_ONFLASH_ENTRIES slots.  Rebuilt by stk_dbIndexInit() and kept
+// up to date by stk_addSticker() and stk_removeSticker().
+uint16_t gStkUidIdx[STK_ONFLASH_ENTRIES];
+uint16_t gStkUidIdxCnt; // Number of valid gStkUidIdx[] entries
+
+// Fast boot: stk_dbIndexBegin() leaves the index empty and stk_dbIndexStep()
+// builds it a few slots at a time from the idle loop.  Until gStkIdxReady is
+// set, lookups fall back to a linear scan of gStkRamFlash.entries[].
+bool     gStkIdxReady;
+uint16_t gStkIdxBuildSlot; // Next slot stk_dbIndexStep() loads
+
+// Struct-of-arrays mirror of gStkRamFlash.entries[].  The packed 12-byte
+// stk_dbEntry puts every uid at an unaligned offset with meta bytes in
+// between; lookups and scans use these aligned arrays instead and leave the
+// packed layout to persistence and config payloads.  Loaded by
+// stk_dbIndexInit() and kept in step by stk_dbLoadSlot().
+uint64_t gStkDbUids[STK_ONFLASH_ENTRIES] __attribute__((aligned(8)));
+uint8_t  gStkDbMeta[STK_ONFLASH_ENTRIES]; // meta1_truST25_mast
+
+// Bloom filter over the enrolled UIDs, so stickers that are not in the DB
+// (transit passes, phones, strangers' cards) are rejected without touching
+// the DB at all.  Bits are only ever set on add, so it is rebuilt from the
+// UID index on remove and by stk_dbIndexInit().
+//
+// Measured false-positive rate with 324 random ST25 UIDs enrolled:
+//     STK_BLOOM_BITS 2048, 4 hashes: 4.9%
+//     STK_BLOOM_BITS 4096, 4 hashes: 0.55%   <-- default (512 bytes)
+//     STK_BLOOM_BITS 4096, 5 hashes: 0.38%
+#ifndef STK_BLOOM_BITS
+#define STK_BLOOM_BITS    (4096) // Must be a power of 2
+#endif
+#ifndef STK_BLOOM_HASHES
+#define STK_BLOOM_HASHES  (4)
+#endif
+ct_assert((STK_BLOOM_BITS & (STK_BLOOM_BITS - 1)) == 0);
+uint8_t gStkBloom[STK_BLOOM_BITS / 8];
+
+// Occupancy bitmap of gStkRamFlash.entries[]: one bit per slot, MSB first,
+// so the first free slot is found with a count-leading-zeros per word
+// instead of scanning entries[] for uid == 0.  The unused tail bits of the
+// last word are kept set so they never look free.  324 bits = 41 bytes,
+// rounded up to 11 words.
+#define STK_OCC_WORDS  ((STK_ONFLASH_ENTRIES + 31) / 32)
+uint32_t gStkOccupied[STK_OCC_WORDS];
+
+// One bit per 96bit gStkRamFlash member that differs from flash.  Set by
+// stk_markDirty(), written back (and cleared) by stk_commitRamFlash().
+#define STK_DIRTY_WORDS  ((STK_ONFLASH_NUM_MEMBERS + 31) / 32)
+uint32_t gStkDirty[STK_DIRTY_WORDS];
+
+// Page digest of the access DB: gStkRamFlash split into pages of
+// STK_PAGE_MEMBERS members, each with a CRC over its DB members (master1 and
+// entries[]; op_mode and the reserved members are per-lock), and a root CRC
+// over the page CRCs.  Locks holding the same DB have the same root.  Page
+// CRCs are recomputed lazily for pages marked stale by stk_markDirty().
+#define STK_PAGE_MEMBERS   (32)
+#define STK_NUM_PAGES      ((STK_ONFLASH_NUM_MEMBERS + STK_PAGE_MEMBERS - 1) / STK_PAGE_MEMBERS)
+#define STK_DIGEST_VERSION (1)
+
+// Stored in reserved1 and reserved2 so Copy_Config carries it to the paste
+// side.  Page 0 holds the digest itself and is always read, so only pages
+// 1 and up are listed.
+typedef struct __attribute__((__packed__))
+{
+    uint8_t  version;     // STK_DIGEST_VERSION
+    uint8_t  numPages;    // STK_NUM_PAGES
+    uint16_t root;
+    uint16_t page[STK_NUM_PAGES - 1]; // Page CRCs for pages 1..STK_NUM_PAGES-1
+} stk_db_digest;
+ct_assert(sizeof(stk_db_digest)==(2 * STK_DB_ENTRY_SIZE));
+
+uint16_t gStkPageCrc[STK_NUM_PAGES];
+uint16_t gStkPageStale; // One bit per page
+ct_assert(STK_NUM_PAGES <= 16);
+
+// State of a STKFUNC_PASTE_CONFIG / STKFUNC_CONFIG_PAYLOAD read in progress
+typedef struct {
+    uint16_t offset;     // Bytes of cp_ofd consumed so far
+    uint16_t numBlks;    // From the payload's op_mode (0 until it is read)
+    uint16_t expCrc;     // From the payload's op_mode
+    uint16_t crc;        // Running CRC of the members read so far
+    uint8_t  member[STK_DB_ENTRY_SIZE]; // Member being assembled
+    stk_db_digest srcDigest; // The source lock's digest (reserved1/2)
+    bool     failed;
+} stk_paste_stream;
+stk_paste_stream gStkPaste;
+
+// Recent-tap cache: the last few stk_isInDB() decisions, most recent first,
+// so a sticker that is re-tapped or left in the field doesn't go through
+// the DB again until STK_TAP_CACHE_TTL_SEC has passed.  Flushed whenever
+// the DB changes.
+#define STK_TAP_CACHE_ENTRIES  (4)
+#define STK_TAP_CACHE_TTL_SEC  (3)
+typedef struct {
+    uint64_t uid;      // 0 = unused
+    uint32_t time;     // RTC seconds when the decision was made
+    int16_t  slot;     // Slot it was found in, -1 = not allowed
+    bool     truST25;  // The truST25 argument the decision was made with
+} stk_tap_cache_ent;
+stk_tap_cache_ent gStkTapCache[STK_TAP_CACHE_ENTRIES];
+uint32_t gStkTapCacheHits;
+uint32_t gStkTapCacheMisses;
+
+// TruST25 cache: UIDs whose TruST25 check (inside isTheSame()) passed in
+// the last STK_TRUST25_CACHE_TTL_SEC.  A cached UID matching a
+// STK_ENTRY_META1_ISTRUST25 slot skips the signature check and its extra RF
+// transactions.  The trade-off is that a clone of a UID verified within the
+// TTL would also be accepted, so keep the TTL short.
+#define STK_TRUST25_CACHE_ENTRIES  (8)
+#define STK_TRUST25_CACHE_TTL_SEC  (60)
+typedef struct {
+    uint64_t uid;      // 0 = unused
+    uint32_t time;     // RTC seconds when it was verified
+} stk_trust25_cache_ent;
+stk_trust25_cache_ent gStkTruST25Cache[STK_TRUST25_CACHE_ENTRIES];
+uint32_t gStkTruST25Checks;     // isTheSame() calls on ISTRUST25 slots
+uint32_t gStkTruST25CacheHits;  // Checks skipped thanks to the cache
+
+// Slot matched by the last stk_isInDB() call, -1 if it was not allowed
+// (what the access log records)
+int16_t gStkLastSlot = -1;
+
+// Access log: an append-only ring of fixed-size records in its own flash
+// region, STK_LOG_NUM_SECTORS erase sectors long.  See ACCESS LOG.
+//
+// Size it for the door: the sector ahead of the head is kept erased and the
+// head's own sector is partly written, so the log holds at least
+// (STK_LOG_NUM_SECTORS - 2) * STK_LOG_RECS_PER_SECTOR records.  The default
+// 16 x 2KB (32KB) region keeps 3584 taps: about 1.8 days at 2000 taps/day,
+// a week at 500.
+#ifndef STK_LOG_SECTOR_LEN
+#define STK_LOG_SECTOR_LEN     (2048)  // Flash erase sector
+#endif
+#ifndef STK_LOG_NUM_SECTORS
+#define STK_LOG_NUM_SECTORS    (16)
+#endif
+#define STK_LOG_REC_LEN        (8)   // One 64-bit flash program operation
+#define STK_LOG_RECS_PER_SECTOR (STK_LOG_SECTOR_LEN / STK_LOG_REC_LEN)
+#define STK_LOG_NUM_RECS       (STK_LOG_RECS_PER_SECTOR * STK_LOG_NUM_SECTORS)
+
+typedef struct {
+    uint16_t head;         // Record index the next append goes to
+    uint16_t seq;          // Sequence number of the next record
+    uint32_t lastTime;     // RTC seconds of the last record
+    int16_t  erasedSector; // Unused sector known to be erased, -1 if none
+} stk_log_state;
+stk_log_state gStkLog;
+
+// Multi-tag field: every ISO15693 tag found by one inventory round, with its
+// stk_dat_always prefetched, so a sticker fob on a keyring next to other tags
+// is found in the same poll cycle.  See MULTI-TAG FIELD.
+#define STK_FIELD_MAX_TAGS  (3)
+typedef struct {
+    rfalNfcDevice  dev;
+    stk_dat_always always;
+    bool           alwaysOk;   // stk_dat_always was read
+} stk_field_tag;
+stk_field_tag gStkField[STK_FIELD_MAX_TAGS];
+uint8_t       gStkFieldCnt;
+uint32_t      gStkFieldPolls[STK_FIELD_MAX_TAGS + 1]; // Inventory rounds by number of tags found
+
+// Spanned config payload in progress: which chunks have been applied to
+// gStkRamFlash (uncommitted).  See SPANNED PAYLOADS.
+#define STK_SPAN_MAX_CHUNKS  (32)
+#define STK_SPAN_TIMEOUT_SEC (TIME_ONE_HOUR_IN_SEC / 2) // Since the last chunk
+typedef struct {
+    uint8_t  total;    // Chunks in the transfer, 0 = none in progress
+    uint16_t dbCrc;    // stk_dbCrc() the finished DB must have, identifies the transfer
+    uint16_t numBlks;  // End of the furthest chunk applied
+    uint32_t done;     // Bit per chunk applied
+    uint32_t lastSec;  // stk_rtcGetSeconds() when the last chunk was applied
+} stk_span_state;
+stk_span_state gStkSpan;
+
+// stk_readStickerData() speculation state and RF counters
+uint8_t  gStkReadHist;        // Bit per recent tap: 1 = needed more than stk_dat_always
+uint32_t gStkReadTaps;
+uint32_t gStkReadTxns;        // RF read commands issued by stk_readStickerData()
+uint32_t gStkReadSpecWasted;  // Speculative reads that only needed stk_dat_always
+uint32_t gStkReadFails;       // stk_readStickerData() failures
+
+// Hot-path timing: a latency histogram and max per tap stage, in units of
+// (1 << STK_STAT_UNIT_SHIFT) cycles of stk_cycleCount().  Bucket 0 is
+// < 1 unit, bucket b is < 2^b units, the last bucket is everything above.
+// See INSTRUMENTATION.
+typedef enum
+{
+    STK_STAGE_FIELD_DETECT = 0,
+    STK_STAGE_ANTICOLL,
+    STK_STAGE_ALWAYS_READ,
+    STK_STAGE_CRC,
+    STK_STAGE_DB_LOOKUP,
+    STK_STAGE_ACTUATE,
+    STK_STAGE_COUNT, // Keep last
+} stk_stage;
+
+#ifndef STK_STAT_UNIT_SHIFT
+#define STK_STAT_UNIT_SHIFT  (14)  // 16384 cycles: ~0.5ms at 32MHz
+#endif
+#define STK_STAT_BUCKETS     (8)
+typedef struct {
+    uint16_t bucket[STK_STAT_BUCKETS]; // Saturating
+    uint32_t max;                      // Cycles
+} stk_stage_stat;
+stk_stage_stat gStkStageStat[STK_STAGE_COUNT];
+
+// The part of the stats that survives a reset, stored in reserved3 and
+// reserved4 (per-lock, never carried by Copy_Config).
+#define STK_STATS_VERSION         (1)
+#define STK_STATS_PERSIST_SEC     (TIME_ONE_HOUR_IN_SEC)
+typedef struct __attribute__((__packed__))
+{
+    uint8_t  version;      // STK_STATS_VERSION
+    uint8_t  unitShift;    // STK_STAT_UNIT_SHIFT
+    uint16_t maxUnits[STK_STAGE_COUNT];
+    uint32_t taps;
+    uint16_t readFails;    // Saturating, as are the two below
+    uint16_t tapCacheHits;
+    uint16_t truST25CacheHits;
+} stk_stats_persist;
+ct_assert(sizeof(stk_stats_persist)==(2 * STK_DB_ENTRY_SIZE));
+uint32_t gStkStatsLastPersist; // RTC seconds
+
+// Poll scheduler: taps per hour of day, 4 bits per hour, persisted in
+// reserved5 together with the stats.  See POLL SCHEDULER.
+#define STK_POLL_HOURS  (24)
+typedef struct __attribute__((__packed__))
+{
+    uint8_t hour[STK_POLL_HOURS / 2]; // Low nibble = even hour, saturating at 15
+} stk_poll_hist;
+ct_assert(sizeof(stk_poll_hist)==STK_DB_ENTRY_SIZE);
+stk_poll_hist gStkPollHist;
+
+typedef enum
+{
+    STK_POLL_FAST = 0,  // Busy hour or recent tap: poll at the fastest rate
+    STK_POLL_NORMAL,
+    STK_POLL_CAP_ONLY,  // Quiet hours: RF polling off, wake on capacitive sense
+    STK_POLL_NUM_MODES, // Keep last
+} stk_poll_mode;
+uint32_t gStkPollDecisions[STK_POLL_NUM_MODES];
+uint32_t gStkPollLastTap;  // RTC seconds of the last distinct tap
+uint32_t gStkPollLastRead; // RTC seconds of the last read, re-detections included
+uint64_t gStkPollLastUid;
 //------------------------------------------------
 //               end GLOBALS
 //------------------------------------------------
@@ -512,55 +688,175 @@ static bool stk_isInDB(       rfalNfcDevice *nfcDev, bool truST25);
 static bool stk_bkupIsInDB   (rfalNfcDevice *nfcDev, stk_data *dat);
 static bool stk_addSticker(   rfalNfcDevice *nfcDev, bool truST25, stk_data *dat);
 static bool stk_removeSticker(rfalNfcDevice *nfcDev, stk_data *dat);
+static bool stk_dbAddUid(uint64_t luid, bool truST25, bool isMaster);
+static bool stk_dbRemoveUid(uint64_t luid);
+static uint64_t stk_nfcDevUid(rfalNfcDevice *nfcDev);
+static void stk_dbIndexEnsure(void);
+bool stk_spanIsOpen(void);
+void stk_spanAbort(void);
+
+// Provided by the emulated EEPROM layer.  Virtual addresses start at 1, see
+// EMULATED_EEPROM_NO_INDEX_ZERO.
+bool stk_eepromWrite32(uint16_t virtAddr, uint32_t data);
+bool stk_eepromRead32( uint16_t virtAddr, uint32_t *data);
+
+void stk_dbIndexInit(void);
+
+// Provided by the platform: free-running RTC seconds
+uint32_t stk_rtcGetSeconds(void);
+
+// Provided by the platform: local wall-clock hour (0..23).  Returns false if
+// the wall clock is not known (not set since power up).
+bool stk_rtcGetHourOfDay(uint8_t *hour);
+
+// Provided by the platform: free-running cycle counter (DWT->CYCCNT on
+// target, clock_gettime() scaled to cycles on host)
+uint32_t stk_cycleCount(void);
+
+// Provided by the platform: the access log flash region.  Offsets are from
+// the start of the region; writes are whole STK_LOG_REC_LEN records.
+bool stk_logFlashErase(uint16_t sector);
+bool stk_logFlashWrite(uint32_t offset, const uint8_t *data, uint16_t len);
+bool stk_logFlashRead( uint32_t offset, uint8_t *data, uint16_t len);
 //------------------------------------------------
 //        end FORWARD DECLARATIONS
 //------------------------------------------------
 
 
+//------------------------------------------------
+//                   CRC16
+//------------------------------------------------
+//
+// The one CRC16 used for sticker data and config images: CRC16-CCITT,
+// reflected (poly 0x8408), preload 0xFFFF, no final XOR.  This gives the
+// same result as stk_crc16Update(0xFFFF, ...), one table lookup per
+// byte instead of RFAL's shift/XOR sequence.  (This is CRC-16/MCRF4XX:
+// "123456789" gives 0x6F91.)
+//
+// Incremental use, e.g. while blocks stream in from RF:
+//
+//     stk_crc16 crc = stk_crc16Init();
+//     crc = stk_crc16Update(crc, blk, len);   // as often as needed
+//     if (stk_crc16Final(crc) == expected) ...
+//
+// The 512-byte table is built by the preprocessor, so it lives in flash
+// and costs nothing at boot.
+//
+#define STK_CRC_PRELOAD  (0xFFFFU)
+#define STK_CRC16_POLY   (0x8408U)
+
+typedef uint16_t stk_crc16;
+
+#define STK_CRC16_BIT(c)  (((c) >> 1) ^ ((0U - ((c) & 1U)) & STK_CRC16_POLY))
+#define STK_CRC16_ENT(n)  STK_CRC16_BIT(STK_CRC16_BIT(STK_CRC16_BIT(STK_CRC16_BIT( \
+                          STK_CRC16_BIT(STK_CRC16_BIT(STK_CRC16_BIT(STK_CRC16_BIT((uint32_t)(n)))))))))
+#define STK_CRC16_R4(n)   STK_CRC16_ENT(n), STK_CRC16_ENT((n) + 1), \
+                          STK_CRC16_ENT((n) + 2), STK_CRC16_ENT((n) + 3)
+#define STK_CRC16_R16(n)  STK_CRC16_R4(n), STK_CRC16_R4((n) + 4), \
+                          STK_CRC16_R4((n) + 8), STK_CRC16_R4((n) + 12)
+#define STK_CRC16_R64(n)  STK_CRC16_R16(n), STK_CRC16_R16((n) + 16), \
+                          STK_CRC16_R16((n) + 32), STK_CRC16_R16((n) + 48)
+
+static const uint16_t gStkCrc16Table[256] = {
+    STK_CRC16_R64(0), STK_CRC16_R64(64), STK_CRC16_R64(128), STK_CRC16_R64(192)
+};
+ct_assert(STK_CRC16_ENT(1) == 0x1189U);
+ct_assert(STK_CRC16_ENT(128) == STK_CRC16_POLY);
+
+static inline stk_crc16 stk_crc16Init(void)
+{
+    return STK_CRC_PRELOAD;
+}
+
+stk_crc16 stk_crc16Update(stk_crc16 crc, const uint8_t *buf, uint32_t len)
+{
+    while (len--) {
+        crc = (crc >> 8) ^ gStkCrc16Table[(crc ^ *buf++) & 0xFFU];
+    }
+    return crc;
+}
+
+static inline uint16_t stk_crc16Final(stk_crc16 crc)
+{
+    return crc;
+}
+
+#ifdef STK_CRC16_SLICE8
 //
-// This securely checks if a sticker is in the DB accounting
-// for the TruST25 validation rules.
+// Slicing-by-8 for host tools that CRC many full images (4KB of tables, so
+// not for the lock).  Same result as stk_crc16Update().
 //
-static bool stk_isInDB(rfalNfcDevice *nfcDev, bool truST25)
+static uint16_t gStkCrc16Slice[8][256];
+
+static void stk_crc16Slice8Init(void)
 {
-    int i = 0;
+    int n = 0;
+    int k = 0;
 
-    for (i = 0; i < STK_ONFLASH_ENTRIES; i++) {
-        if ( (gStkRamFlash.entries[i].uid != 0) &&
-              isTheSame(nfcDev, truST25, IDX_uids, i)
-           )
-        {
-            platformLog("Found in slot [%d]\n", i);
-            return true;
+    for (n = 0; n < 256; n++) {
+        gStkCrc16Slice[0][n] = gStkCrc16Table[n];
+    }
+    for (k = 1; k < 8; k++) {
+        for (n = 0; n < 256; n++) {
+            uint16_t lprev = gStkCrc16Slice[k - 1][n];
+            gStkCrc16Slice[k][n] = (lprev >> 8) ^ gStkCrc16Table[lprev & 0xFFU];
         }
     }
+}
 
-    return false;
+stk_crc16 stk_crc16UpdateSlice8(stk_crc16 crc, const uint8_t *buf, uint32_t len)
+{
+    if (gStkCrc16Slice[1][1] == 0) {
+        stk_crc16Slice8Init();
+    }
+
+    while (len >= 8) {
+        crc ^= (uint16_t)(buf[0] | (buf[1] << 8));
+        crc = gStkCrc16Slice[7][crc & 0xFFU] ^ gStkCrc16Slice[6][crc >> 8] ^
+              gStkCrc16Slice[5][buf[2]]      ^ gStkCrc16Slice[4][buf[3]]  ^
+              gStkCrc16Slice[3][buf[4]]      ^ gStkCrc16Slice[2][buf[5]]  ^
+              gStkCrc16Slice[1][buf[6]]      ^ gStkCrc16Slice[0][buf[7]];
+        buf += 8;
+        len -= 8;
+    }
+
+    return stk_crc16Update(crc, buf, len);
 }
+#endif // STK_CRC16_SLICE8
+//------------------------------------------------
+//                 end CRC16
+//------------------------------------------------
 
 
+//------------------------------------------------
+//               FLASH WRITE-BACK
+//------------------------------------------------
+
+#define STK_WORDS_PER_MEMBER  (STK_DB_ENTRY_SIZE / 4)
+ct_assert(STK_WORDS_PER_MEMBER == 3);
+
 //
-// Backup Sticker is in DB
-//
-// This is not secure, it does not account for TruST25.  Only
-// use this if master has already been presented (i.e. in the
-// master state).  This only checks if a UID is in the DB.
+// Mark a member of gStkRamFlash as changed.  Takes the same (idx, i) pair as
+// stk_writeToRamFlash_ent()/stk_writeToRamFlash_uid().
 //
-static bool stk_bkupIsInDB(rfalNfcDevice *nfcDev, stk_data *dat)
+void stk_markDirty(stk_onflash_idx idx, int i)
 {
-    int i = 0;
+    int lmember = idx + i;
 
-    uint64_t luid = stk_nfcDev_or_backupStk(nfcDev, dat);
-    if (luid == 0) {
-        return false;
+    assert_param(lmember < STK_ONFLASH_NUM_MEMBERS);
+    gStkDirty[lmember / 32] |= (1UL << (lmember % 32));
+
+    if ( (lmember == IDX_master1) || (lmember >= IDX_uids) ) {
+        gStkPageStale |= (uint16_t)(1U << (lmember / STK_PAGE_MEMBERS));
     }
+}
 
-    for (i = 0; i < STK_ONFLASH_ENTRIES; i++) {
-        if ( (gStkRamFlash.entries[i].uid != 0) &&
-             (gStkRamFlash.entries[i].uid == luid)
-           )
-        {
-            platformLog("Found in slot [%d]\n", i);
+bool stk_isDirty(void)
+{
+    int w = 0;
+
+    for (w = 0; w < STK_DIRTY_WORDS; w++) {
+        if (gStkDirty[w] != 0) {
             return true;
         }
     }
@@ -568,92 +864,2496 @@ static bool stk_bkupIsInDB(rfalNfcDevice *nfcDev, stk_data *dat)
     return false;
 }
 
+//
+// Write only the changed 12-byte members of gStkRamFlash to the emulated
+// EEPROM.
+//
+// Adds and removes only update RAM and mark the member dirty.  The state
+// machine calls this once when a master session ends (exit or timeout), so
+// enrolling a stack of stickers costs one deferred commit of just the
+// touched slots instead of a write of the whole 3984-byte image per sticker.
+//
+// Returns false if a write failed; the failed members stay dirty so the
+// next call retries them.  Also refuses (and writes nothing) while a spanned
+// payload is in progress, see stk_spanIsOpen().
+//
+bool stk_commitRamFlash(void)
+{
+    int w = 0;
+    int k = 0;
+    int lnumWritten = 0;
+    bool lok = true;
+
+    // Everything dirty belongs to the spanned payload until it completes
+    if (stk_spanIsOpen()) {
+        platformLog("Commit refused: span in progress\n");
+        return false;
+    }
 
-static bool stk_addSticker(rfalNfcDevice *nfcDev, bool truST25, stk_data *dat)
+    for (w = 0; w < STK_DIRTY_WORDS; w++) {
+        uint32_t lpending = gStkDirty[w];
+        gStkDirty[w] = 0;
+
+        while (lpending != 0) {
+            int b       = __builtin_ctz(lpending);
+            int lmember = (w * 32) + b;
+            uint32_t lwords[STK_WORDS_PER_MEMBER];
+
+            lpending &= ~(1UL << b);
+            memcpy((uint8_t *)lwords, (uint8_t *)&gSRF[lmember], STK_DB_ENTRY_SIZE);
+
+            for (k = 0; k < STK_WORDS_PER_MEMBER; k++) {
+                uint16_t lvirtAddr = 1 + (lmember * STK_WORDS_PER_MEMBER) + k;
+                if (!stk_eepromWrite32(lvirtAddr, lwords[k])) {
+                    break;
+                }
+            }
+
+            if (k == STK_WORDS_PER_MEMBER) {
+                lnumWritten++;
+            } else {
+                platformLog("EEPROM write failed, member [%d]\n", lmember);
+                gStkDirty[w] |= (1UL << b);
+                lok = false;
+            }
+        }
+    }
+
+    platformLog("Committed %d members\n", lnumWritten);
+
+    return lok;
+}
+
+static bool stk_memberIsDirty(int lmember)
 {
-    assert_param(nfcDev != NULL);
-    assert_param(dat    != NULL);
+    return (gStkDirty[lmember / 32] & (1UL << (lmember % 32))) != 0;
+}
 
-    int i = 0;
-    bool lisAMaster = false; // Local, is a master
+// The committed copy of one member, from the emulated EEPROM
+static bool stk_eepromReadMember(int lmember, stk_dbEntry *ent)
+{
+    uint32_t lwords[STK_WORDS_PER_MEMBER];
+    int k = 0;
 
-    uint64_t luid = stk_nfcDev_or_backupStk(nfcDev, dat);
-    if (luid == 0) {
-        return false;
+    for (k = 0; k < STK_WORDS_PER_MEMBER; k++) {
+        uint16_t lvirtAddr = 1 + (lmember * STK_WORDS_PER_MEMBER) + k;
+        if (!stk_eepromRead32(lvirtAddr, &lwords[k])) {
+            return false;
+        }
     }
+    memcpy((uint8_t *)ent, (uint8_t *)lwords, STK_DB_ENTRY_SIZE);
 
-    // See if its already in a slot
-    for (i = 0; i < STK_ONFLASH_ENTRIES; i++) {
-        if (gStkRamFlash.entries[i].uid == luid) {
-            platformLog("Already in slot [%d]\n", i);
-            return true;
+    return true;
+}
+
+//
+// Throw away uncommitted changes: reload every dirty member of gStkRamFlash
+// from the emulated EEPROM.
+//
+// Returns false if a read failed; those members keep their RAM copy and stay
+// dirty, so the next call retries them.
+//
+bool stk_revertRamFlash(void)
+{
+    int w = 0;
+    bool lok = true;
+
+    for (w = 0; w < STK_DIRTY_WORDS; w++) {
+        uint32_t lpending = gStkDirty[w];
+
+        while (lpending != 0) {
+            int b       = __builtin_ctz(lpending);
+            int lmember = (w * 32) + b;
+
+            lpending &= ~(1UL << b);
+            if (stk_eepromReadMember(lmember, &gSRF[lmember])) {
+                gStkDirty[w] &= ~(1UL << b);
+            } else {
+                platformLog("EEPROM read failed, member [%d]\n", lmember);
+                lok = false;
+            }
         }
     }
 
-    // Already verified in stk_isValidSticker()
-    if (dat->always.function == STKFUNC_MASTER) {
-        lisAMaster = true;
+    return lok;
+}
+
+//
+// Empty the UID entries from member numBlks on (a paste or spanned payload
+// image ends there), marking the ones that change dirty.
+//
+static void stk_zeroTail(uint16_t numBlks)
+{
+    int i = (numBlks > IDX_uids) ? numBlks : IDX_uids;
+    stk_dbEntry lZeroEnt;
+
+    memset((uint8_t *)&lZeroEnt, 0, sizeof(stk_dbEntry));
+    for (; i < STK_ONFLASH_NUM_MEMBERS; i++) {
+        if (memcmp((uint8_t *)&gSRF[i], (uint8_t *)&lZeroEnt, STK_DB_ENTRY_SIZE) != 0) {
+            memcpy((uint8_t *)&gSRF[i], (uint8_t *)&lZeroEnt, STK_DB_ENTRY_SIZE);
+            stk_markDirty(IDX_op_mode, i);
+        }
     }
+}
 
-    // If its a backup sticker and the meta data says the associated user
-    // sticker should have TruST25, then mark it as such.
-    if ( (dat->always.function == STKFUNC_BACKUP_STICKER) &&
-         (dat->always.version > STK_ONSTICK_DATA_VERSION1) &&
-         (dat->payload.fmat.meta1_truST25 == 1) )
-    {
-        truST25 = true;
+//
+// CRC16-CCITT of the access DB alone (master1 and entries[]), skipping
+// op_mode and the reserved members, which are per-lock.  Locks configured
+// from the same image have the same DB CRC until they are changed locally.
+//
+uint16_t stk_dbCrc(void)
+{
+    stk_crc16 lcrc = stk_crc16Init();
+
+    lcrc = stk_crc16Update(lcrc, (uint8_t *)&gSRF[IDX_master1], STK_DB_ENTRY_SIZE);
+    lcrc = stk_crc16Update(lcrc, (uint8_t *)&gSRF[IDX_uids],
+                           STK_ONFLASH_ENTRIES * STK_DB_ENTRY_SIZE);
+    return stk_crc16Final(lcrc);
+}
+
+static uint16_t stk_pageCrc(const stk_dbEntry *mem, int p)
+{
+    int m = p * STK_PAGE_MEMBERS;
+    int lend = m + STK_PAGE_MEMBERS;
+    stk_crc16 lcrc = stk_crc16Init();
+
+    if (lend > STK_ONFLASH_NUM_MEMBERS) {
+        lend = STK_ONFLASH_NUM_MEMBERS;
     }
 
-    // Find a blank spot
-    for (i = 0; i < STK_ONFLASH_ENTRIES; i++) {
-        if (gStkRamFlash.entries[i].uid == 0) {
-            stk_writeToRamFlash_uid(luid, truST25, lisAMaster, IDX_uids, i);
-            platformLog("Added to slot [%d]\n", i);
-            return true;
+    for (; m < lend; m++) {
+        if ( (m == IDX_master1) || (m >= IDX_uids) ) {
+            lcrc = stk_crc16Update(lcrc, (const uint8_t *)&mem[m], STK_DB_ENTRY_SIZE);
         }
     }
 
-    return false;
+    return stk_crc16Final(lcrc);
 }
 
+static void stk_digestBuild(const uint16_t *pageCrc, stk_db_digest *dig)
+{
+    memset((uint8_t *)dig, 0, sizeof(stk_db_digest));
+    dig->version  = STK_DIGEST_VERSION;
+    dig->numPages = STK_NUM_PAGES;
+    dig->root     = stk_crc16Final(stk_crc16Update(stk_crc16Init(), (const uint8_t *)pageCrc,
+                                                   STK_NUM_PAGES * sizeof(uint16_t)));
+    memcpy((uint8_t *)dig->page, (const uint8_t *)&pageCrc[1], sizeof(dig->page));
+}
 
-static bool stk_removeSticker(rfalNfcDevice *nfcDev, stk_data *dat)
+// Bring gStkPageCrc[] up to date.  It is only a cache: gStkRamFlash, the
+// dirty bits and the EEPROM are not touched.
+static void stk_pageCrcRefresh(void)
 {
-    assert_param(nfcDev != NULL);
-    assert_param(dat    != NULL);
+    int p = 0;
 
-    int i = 0;
+    for (p = 0; p < STK_NUM_PAGES; p++) {
+        if (gStkPageStale & (1U << p)) {
+            gStkPageCrc[p] = stk_pageCrc(gSRF, p);
+        }
+    }
+    gStkPageStale = 0;
+}
 
-    // AVOID_CONFUSION_DO_NOTHING
-    //
-    // We should be able to return an error from this function
-    // to indicate that we were not able to remove the sticker.
-    // Instead of flashing red (which is what we do when a remove
-    // is successful), lets instead not blink anything.
-    //
-    // This is to avoid confusion.  For example, if you blink some
-    // sort of red code to indicate error, that is confusing because
-    // the user is expecting to see red anyways since they are removing
-    // a sticker.
+//
+// The root digest of the DB as it is in RAM, which is what
+// STKFUNC_GET_DEBUG_INFO reports for fleet sync checks.  Stores nothing, see
+// stk_dbDigest().
+//
+uint16_t stk_dbDigestRoot(void)
+{
+    stk_db_digest ldig;
 
-    uint64_t luid = stk_nfcDev_or_backupStk(nfcDev, dat);
-    if (luid == 0) {
-        return false;
+    stk_pageCrcRefresh();
+    stk_digestBuild(gStkPageCrc, &ldig);
+
+    return ldig.root;
+}
+
+//
+// Bring the page CRCs and root digest up to date and store them in
+// reserved1/reserved2 (marked dirty if they changed).  Returns the root
+// digest.  Call before Copy_Config so the copied image carries the page
+// CRCs.
+//
+uint16_t stk_dbDigest(void)
+{
+    stk_db_digest ldig;
+
+    stk_pageCrcRefresh();
+    stk_digestBuild(gStkPageCrc, &ldig);
+
+    if (memcmp((uint8_t *)&gSRF[IDX_reserved1], (uint8_t *)&ldig, sizeof(ldig)) != 0) {
+        memcpy((uint8_t *)&gSRF[IDX_reserved1], (uint8_t *)&ldig, sizeof(ldig));
+        stk_markDirty(IDX_reserved1, 0);
+        stk_markDirty(IDX_reserved2, 0);
     }
 
-    stk_dbEntry lZeroEnt;
-    memset((uint8_t *)&lZeroEnt, 0, sizeof(stk_dbEntry));
+    return ldig.root;
+}
 
-    for (i = 0; i < STK_ONFLASH_ENTRIES; i++) {
-        if ( (gStkRamFlash.entries[i].uid != 0) &&
-             (gStkRamFlash.entries[i].uid == luid)
-           )
-        {
-            // Write all 0's to the slot
-            stk_writeToRamFlash_ent(&lZeroEnt, IDX_uids, i);
-            platformLog("Removed from slot [%d]\n", i);
+//
+// The CRC stored in stk_opMode.crc for Copy_Config, Paste_Config and
+// Config_Payload images: stk_crc16 over members 1 to numBlks-1, i.e.
+// everything after op_mode.  Touches no globals, so a host payload generator
+// can run it on many images in parallel.
+//
+uint16_t stk_ofdCrc(const stk_onflash_data *ofd, uint16_t numBlks)
+{
+    const stk_dbEntry *lmem = (const stk_dbEntry *)ofd;
+
+    assert_param(numBlks <= STK_ONFLASH_NUM_MEMBERS);
+
+    if (numBlks <= IDX_master1) {
+        return stk_crc16Final(stk_crc16Init());
+    }
+
+    return stk_crc16Final(stk_crc16Update(stk_crc16Init(), (const uint8_t *)&lmem[IDX_master1],
+                                          (numBlks - IDX_master1) * STK_DB_ENTRY_SIZE));
+}
+
+//
+// Fill in the header of a Config_Payload image (cp_ofd): the page digest in
+// reserved1/reserved2 (what a paste uses to skip unchanged pages), then
+// op_mode version, numBlks up to the last used entry, and crc.  Returns
+// numBlks.  Reentrant, like stk_ofdCrc().
+//
+uint16_t stk_ofdSeal(stk_onflash_data *ofd)
+{
+    int i = STK_ONFLASH_ENTRIES;
+    int p = 0;
+    uint16_t lnumBlks = 0;
+    uint16_t lpageCrc[STK_NUM_PAGES];
+    stk_db_digest ldig;
+
+    for (p = 0; p < STK_NUM_PAGES; p++) {
+        lpageCrc[p] = stk_pageCrc((const stk_dbEntry *)ofd, p);
+    }
+    stk_digestBuild(lpageCrc, &ldig);
+    memcpy((uint8_t *)&ofd->reserved1, (uint8_t *)&ldig, sizeof(ldig));
+
+    while ( (i > 0) && (ofd->entries[i - 1].uid == 0) ) {
+        i--;
+    }
+    lnumBlks = (uint16_t)(IDX_uids + i);
+
+    ofd->op_mode.version = STK_ONFLASH_DATA_VERSION;
+    ofd->op_mode.numBlks = lnumBlks;
+    ofd->op_mode.crc     = stk_ofdCrc(ofd, lnumBlks);
+
+    return lnumBlks;
+}
+
+// stk_ofdCrc() of gStkRamFlash
+uint16_t stk_ramFlashCrc(uint16_t numBlks)
+{
+    return stk_ofdCrc(&gStkRamFlash, numBlks);
+}
+//------------------------------------------------
+//             end FLASH WRITE-BACK
+//------------------------------------------------
+
+
+//------------------------------------------------
+//               INSTRUMENTATION
+//------------------------------------------------
+//
+// Usage, around each tap stage:
+//
+//     uint32_t t = stk_statStart();
+//     ... stage ...
+//     stk_statStop(STK_STAGE_DB_LOOKUP, t);
+//
+// The always-block read, anticollision and DB lookup are timed here; field
+// detect, CRC and actuation are timed by the state machine around its own
+// code.
+//
+
+static inline uint32_t stk_statStart(void)
+{
+    return stk_cycleCount();
+}
+
+void stk_statStop(stk_stage stage, uint32_t start)
+{
+    uint32_t lcycles = stk_cycleCount() - start; // Wraps correctly
+    uint32_t lunits  = lcycles >> STK_STAT_UNIT_SHIFT;
+    int      b       = 0;
+    stk_stage_stat *lst = &gStkStageStat[stage];
+
+    assert_param(stage < STK_STAGE_COUNT);
+
+    if (lunits != 0) {
+        b = 32 - __builtin_clz(lunits);
+        if (b >= STK_STAT_BUCKETS) {
+            b = STK_STAT_BUCKETS - 1;
         }
     }
+    if (lst->bucket[b] != 0xFFFFU) {
+        lst->bucket[b]++;
+    }
+    if (lcycles > lst->max) {
+        lst->max = lcycles;
+    }
+}
 
-    return true;
+static uint16_t stk_stat16(uint32_t v)
+{
+    return (v > 0xFFFFU) ? 0xFFFFU : (uint16_t)v;
+}
+
+//
+// Restore the persisted part of the stats (boot, after gStkRamFlash is
+// loaded).
+//
+void stk_statsInit(void)
+{
+    stk_stats_persist lper;
+    int s = 0;
+
+    memset((uint8_t *)gStkStageStat, 0, sizeof(gStkStageStat));
+    memcpy((uint8_t *)&lper, (uint8_t *)&gSRF[IDX_reserved3], sizeof(lper));
+
+    if ( (lper.version == STK_STATS_VERSION) && (lper.unitShift == STK_STAT_UNIT_SHIFT) ) {
+        for (s = 0; s < STK_STAGE_COUNT; s++) {
+            gStkStageStat[s].max = (uint32_t)lper.maxUnits[s] << STK_STAT_UNIT_SHIFT;
+        }
+        gStkReadTaps         = lper.taps;
+        gStkReadFails        = lper.readFails;
+        gStkTapCacheHits     = lper.tapCacheHits;
+        gStkTruST25CacheHits = lper.truST25CacheHits;
+    }
+
+    gStkStatsLastPersist = stk_rtcGetSeconds();
 }
+
+//
+// Call from the idle loop.  Every STK_STATS_PERSIST_SEC writes the stats to
+// reserved3/reserved4 and the poll scheduler's tap histogram to reserved5.
+// Skipped while a master session has uncommitted changes, so this never
+// commits someone else's half-done edit.
+//
+void stk_statsService(void)
+{
+    stk_stats_persist lper;
+    uint32_t lnow = stk_rtcGetSeconds();
+    int s = 0;
+
+    if ( ((lnow - gStkStatsLastPersist) < STK_STATS_PERSIST_SEC) || stk_isDirty() ||
+         stk_spanIsOpen() )
+    {
+        return;
+    }
+    gStkStatsLastPersist = lnow;
+
+    memset((uint8_t *)&lper, 0, sizeof(lper));
+    lper.version   = STK_STATS_VERSION;
+    lper.unitShift = STK_STAT_UNIT_SHIFT;
+    for (s = 0; s < STK_STAGE_COUNT; s++) {
+        lper.maxUnits[s] = stk_stat16(gStkStageStat[s].max >> STK_STAT_UNIT_SHIFT);
+    }
+    lper.taps             = gStkReadTaps;
+    lper.readFails        = stk_stat16(gStkReadFails);
+    lper.tapCacheHits     = stk_stat16(gStkTapCacheHits);
+    lper.truST25CacheHits = stk_stat16(gStkTruST25CacheHits);
+
+    if (memcmp((uint8_t *)&gSRF[IDX_reserved3], (uint8_t *)&lper, sizeof(lper)) != 0) {
+        memcpy((uint8_t *)&gSRF[IDX_reserved3], (uint8_t *)&lper, sizeof(lper));
+        stk_markDirty(IDX_reserved3, 0);
+        stk_markDirty(IDX_reserved4, 0);
+    }
+    if (memcmp((uint8_t *)&gSRF[IDX_reserved5], (uint8_t *)&gStkPollHist, sizeof(gStkPollHist)) != 0) {
+        memcpy((uint8_t *)&gSRF[IDX_reserved5], (uint8_t *)&gStkPollHist, sizeof(gStkPollHist));
+        stk_markDirty(IDX_reserved5, 0);
+    }
+
+    if (stk_isDirty()) {
+        stk_commitRamFlash();
+    }
+}
+
+//
+// STKFUNC_GET_DEBUG_INFO export.  Little-endian, no padding:
+//
+//     uint8_t  version      STK_STATS_VERSION
+//     uint8_t  numStages    STK_STAGE_COUNT (stk_stage order)
+//     uint8_t  numBuckets   STK_STAT_BUCKETS
+//     uint8_t  unitShift    STK_STAT_UNIT_SHIFT
+//     per stage:
+//         uint32_t max      cycles
+//         uint16_t bucket[numBuckets]
+//     uint8_t  numCounters  STK_STATS_NUM_COUNTERS
+//     uint32_t counter[numCounters]   see lcounters[] below, append only
+//
+// Counter 11 is the stk_dbDigestRoot() for fleet sync checks (0 while a
+// spanned payload is open, the DB is half written then), 12..15 are
+// gStkFieldPolls[], inventory rounds that found 0..3 tags.
+//
+// A decoder must use the counts in the header, not its own constants, so
+// new stages, buckets or counters don't break older tools.  Returns the
+// number of bytes written, 0 if buf is too small.
+//
+#define STK_STATS_NUM_COUNTERS  (16)
+ct_assert(STK_FIELD_MAX_TAGS == 3); // gStkFieldPolls[] in lcounters[]
+#define STK_STATS_EXPORT_LEN    (4 + (STK_STAGE_COUNT * (4 + (2 * STK_STAT_BUCKETS))) + \
+                                 1 + (4 * STK_STATS_NUM_COUNTERS))
+
+uint16_t stk_statsExport(uint8_t *buf, uint16_t bufLen)
+{
+    uint32_t lcounters[STK_STATS_NUM_COUNTERS] = {
+        gStkReadTaps,
+        gStkReadFails,
+        gStkReadTxns,
+        gStkReadSpecWasted,
+        gStkTapCacheHits,
+        gStkTapCacheMisses,
+        gStkTruST25Checks,
+        gStkTruST25CacheHits,
+        gStkPollDecisions[STK_POLL_FAST],
+        gStkPollDecisions[STK_POLL_NORMAL],
+        gStkPollDecisions[STK_POLL_CAP_ONLY],
+        stk_spanIsOpen() ? 0 : stk_dbDigestRoot(),
+        gStkFieldPolls[0],
+        gStkFieldPolls[1],
+        gStkFieldPolls[2],
+        gStkFieldPolls[3],
+    };
+    uint8_t *p = buf;
+    int s = 0;
+    int b = 0;
+
+    assert_param(buf != NULL);
+    if (bufLen < STK_STATS_EXPORT_LEN) {
+        return 0;
+    }
+
+    *p++ = STK_STATS_VERSION;
+    *p++ = STK_STAGE_COUNT;
+    *p++ = STK_STAT_BUCKETS;
+    *p++ = STK_STAT_UNIT_SHIFT;
+
+    // The MCU is little-endian, so plain copies give the documented format
+    for (s = 0; s < STK_STAGE_COUNT; s++) {
+        memcpy(p, (uint8_t *)&gStkStageStat[s].max, 4);
+        p += 4;
+        for (b = 0; b < STK_STAT_BUCKETS; b++) {
+            memcpy(p, (uint8_t *)&gStkStageStat[s].bucket[b], 2);
+            p += 2;
+        }
+    }
+
+    *p++ = STK_STATS_NUM_COUNTERS;
+    memcpy(p, (uint8_t *)lcounters, sizeof(lcounters));
+    p += sizeof(lcounters);
+
+    return (uint16_t)(p - buf);
+}
+//------------------------------------------------
+//             end INSTRUMENTATION
+//------------------------------------------------
+
+
+//------------------------------------------------
+//               POLL SCHEDULER
+//------------------------------------------------
+//
+// Learns when the lock gets used and picks the RF polling rate to match:
+//
+//     switch (stk_pollDecide()) {   // before each poll
+//         STK_POLL_FAST:     poll again right away, skip the idle sleep
+//         STK_POLL_NORMAL:   the existing idle sleep between polls
+//         STK_POLL_CAP_ONLY: no RF polling until the capacitive wake
+//     }
+//
+// The scheduler only picks between the cadences the platform already has,
+// it does not define new ones.
+//
+// Each distinct tap counts towards its hour of day.  Hours with at least
+// half the taps of the busiest hour poll fast, hours with no taps that are
+// not followed by a busy one wait for the capacitive wake (hwtuneCap), the
+// rest poll at the normal rate.  A tap always switches to fast polling for
+// STK_POLL_BURST_SEC, and wall power always polls fast.  Until there is
+// STK_POLL_MIN_HISTORY taps of history the normal rate is used.
+//
+// The hour comes from stk_rtcGetHourOfDay(), not stk_rtcGetSeconds(): the
+// latter is free-running from power up (and ~8% off, see
+// RTC_FUDGE_FACTOR), so its "hours" drift through the day and shift on
+// every battery change.  Without a wall clock nothing is learned and the
+// normal rate is used, apart from the tap burst.
+//
+#define STK_POLL_BURST_SEC    (60)
+#define STK_POLL_MIN_HISTORY  (8)   // Halving keeps the total small, see stk_pollRecordTap()
+#define STK_POLL_MAX_COUNT    (15)
+#define STK_POLL_TAP_GAP_SEC  (2)   // Same UID read again after this long is a new tap
+
+static uint8_t stk_pollCount(int hour)
+{
+    return (uint8_t)((gStkPollHist.hour[hour / 2] >> ((hour % 2) * 4)) & 0x0FU);
+}
+
+// Restore the tap histogram (boot, after gStkRamFlash is loaded)
+void stk_pollInit(void)
+{
+    memcpy((uint8_t *)&gStkPollHist, (uint8_t *)&gSRF[IDX_reserved5], sizeof(gStkPollHist));
+}
+
+//
+// Call on every sticker read.  A sticker left on the reader is read again
+// every poll, so only a new UID, or one that was out of the field for
+// STK_POLL_TAP_GAP_SEC, counts as a tap.
+//
+// A tap counts in the current hour.  When an hour saturates every hour is
+// halved, so the histogram follows changing habits and keeps its shape.
+//
+void stk_pollRecordTap(uint64_t uid)
+{
+    uint32_t lnow = stk_rtcGetSeconds();
+    bool     lnew = (uid != gStkPollLastUid) ||
+                    ((lnow - gStkPollLastRead) >= STK_POLL_TAP_GAP_SEC);
+    uint8_t  lhour = 0;
+    int      i = 0;
+
+    gStkPollLastRead = lnow;
+    gStkPollLastUid  = uid;
+    if (!lnew) {
+        return;
+    }
+
+    gStkPollLastTap = lnow;
+    if (!stk_rtcGetHourOfDay(&lhour) || (lhour >= STK_POLL_HOURS)) {
+        return;
+    }
+
+    if (stk_pollCount(lhour) == STK_POLL_MAX_COUNT) {
+        for (i = 0; i < (STK_POLL_HOURS / 2); i++) {
+            gStkPollHist.hour[i] = (gStkPollHist.hour[i] >> 1) & 0x77U;
+        }
+    }
+    gStkPollHist.hour[lhour / 2] += (uint8_t)(1U << ((lhour % 2) * 4));
+}
+
+stk_poll_mode stk_pollDecide(void)
+{
+    uint32_t lnow  = stk_rtcGetSeconds();
+    uint8_t  lhour = 0;
+    bool     lclock = stk_rtcGetHourOfDay(&lhour) && (lhour < STK_POLL_HOURS);
+    uint8_t  lcur  = 0;
+    uint8_t  lnext = 0;
+    uint8_t  lmax  = 0;
+    uint16_t ltotal = 0;
+    stk_poll_mode lmode = STK_POLL_NORMAL;
+    int h = 0;
+
+    if (lclock) {
+        lcur  = stk_pollCount(lhour);
+        lnext = stk_pollCount((lhour + 1) % STK_POLL_HOURS);
+    }
+
+    for (h = 0; h < STK_POLL_HOURS; h++) {
+        uint8_t c = stk_pollCount(h);
+        ltotal += c;
+        if (c > lmax) {
+            lmax = c;
+        }
+    }
+
+    if ( (gStkRamFlash.op_mode.mode & STK_OPMODE_MODE_WALL_POWER) ||
+         ((lnow - gStkPollLastTap) < STK_POLL_BURST_SEC) )
+    {
+        lmode = STK_POLL_FAST;
+    } else if ( !lclock || (ltotal < STK_POLL_MIN_HISTORY) ) {
+        lmode = STK_POLL_NORMAL; // No wall clock, or still learning
+    } else if ((lcur * 2) >= lmax) {
+        lmode = STK_POLL_FAST;
+    } else if ( (lcur == 0) && ((lnext * 2) < lmax) ) {
+        lmode = STK_POLL_CAP_ONLY;
+    }
+
+    gStkPollDecisions[lmode]++;
+    return lmode;
+}
+//------------------------------------------------
+//             end POLL SCHEDULER
+//------------------------------------------------
+
+
+//------------------------------------------------
+//               STREAMING PASTE
+//------------------------------------------------
+//
+// Config payloads are applied as they stream in from RF rather than being
+// staged in a 4KB copy first:
+//
+//     if (!stk_pasteBegin()) {
+//         return;          // Earlier changes could not be committed
+//     }
+//     while (stk_pasteBytesNeeded() > 0) {
+//         read the next chunk of cp_ofd from the sticker
+//         stk_pasteFeed(chunk, len);
+//     }
+//     stk_pasteFinish();   // or stk_pasteAbort() if the sticker was pulled
+//
+// Each completed member is CRC'd and copied straight into gStkRamFlash (and
+// marked dirty) as it arrives.  Nothing reaches flash until stk_pasteFinish() sees
+// the final CRC match; any failure reverts the dirty members from flash, so
+// the paste is all-or-nothing.
+//
+// Only master1 and the UID entries are taken from the payload.  op_mode and
+// the reserved members hold per-lock state (counters, hardware tuning) and
+// are kept.
+//
+
+bool stk_pasteBegin(void)
+{
+    // A paste replaces a half-finished spanned payload
+    stk_spanAbort();
+
+    // Everything dirty from here on belongs to the paste
+    stk_commitRamFlash();
+    if (stk_isDirty()) {
+        // Failed EEPROM write: a revert would take those changes with it
+        platformLog("Paste refused: uncommitted changes\n");
+        return false;
+    }
+
+    memset((uint8_t *)&gStkPaste, 0, sizeof(gStkPaste));
+    gStkPaste.crc = stk_crc16Init();
+
+    return true;
+}
+
+// Number of cp_ofd bytes still to be fed, 0 once the payload is complete or
+// has failed
+uint16_t stk_pasteBytesNeeded(void)
+{
+    if (gStkPaste.failed) {
+        return 0;
+    }
+
+    if (gStkPaste.numBlks == 0) {
+        // op_mode not read yet
+        return STK_DB_ENTRY_SIZE - gStkPaste.offset;
+    }
+
+    return (gStkPaste.numBlks * STK_DB_ENTRY_SIZE) - gStkPaste.offset;
+}
+
+static void stk_pasteMember(int lmember)
+{
+    stk_opMode *lop = (stk_opMode *)gStkPaste.member;
+
+    if (lmember == IDX_op_mode) {
+        if ( (lop->version != STK_ONFLASH_DATA_VERSION) ||
+             (lop->numBlks <= IDX_master1) ||
+             (lop->numBlks >  STK_ONFLASH_NUM_MEMBERS) )
+        {
+            platformLog("Paste: bad header v%d numBlks %d\n", lop->version, lop->numBlks);
+            gStkPaste.failed = true;
+            return;
+        }
+        gStkPaste.numBlks = lop->numBlks;
+        gStkPaste.expCrc  = lop->crc;
+        return;
+    }
+
+    gStkPaste.crc = stk_crc16Update(gStkPaste.crc, gStkPaste.member, STK_DB_ENTRY_SIZE);
+
+    if ( (lmember == IDX_reserved1) || (lmember == IDX_reserved2) ) {
+        memcpy(((uint8_t *)&gStkPaste.srcDigest) + ((lmember - IDX_reserved1) * STK_DB_ENTRY_SIZE),
+               gStkPaste.member, STK_DB_ENTRY_SIZE);
+    }
+
+    if ( (lmember == IDX_master1) || (lmember >= IDX_uids) ) {
+        if (memcmp((uint8_t *)&gSRF[lmember], gStkPaste.member, STK_DB_ENTRY_SIZE) != 0) {
+            memcpy((uint8_t *)&gSRF[lmember], gStkPaste.member, STK_DB_ENTRY_SIZE);
+            stk_markDirty(IDX_op_mode, lmember);
+        }
+    }
+}
+
+//
+// Feed the next len bytes of cp_ofd.  Returns false once the payload has
+// been rejected.
+//
+bool stk_pasteFeed(const uint8_t *buf, uint16_t len)
+{
+    uint16_t i = 0;
+
+    for (i = 0; (i < len) && (stk_pasteBytesNeeded() > 0); i++) {
+        gStkPaste.member[gStkPaste.offset % STK_DB_ENTRY_SIZE] = buf[i];
+        gStkPaste.offset++;
+
+        if ((gStkPaste.offset % STK_DB_ENTRY_SIZE) == 0) {
+            stk_pasteMember((gStkPaste.offset / STK_DB_ENTRY_SIZE) - 1);
+        }
+    }
+
+    return !gStkPaste.failed;
+}
+
+void stk_pasteAbort(void)
+{
+    stk_revertRamFlash();
+    stk_dbIndexInit();
+}
+
+//
+// Commit the paste if the whole payload arrived and its CRC matches,
+// otherwise revert.  Returns true if the new config was applied.
+//
+bool stk_pasteFinish(void)
+{
+    if ( gStkPaste.failed ||
+         (gStkPaste.numBlks == 0) ||
+         (stk_pasteBytesNeeded() != 0) ||
+         (stk_crc16Final(gStkPaste.crc) != gStkPaste.expCrc) )
+    {
+        platformLog("Paste failed: CRC 0x%04x expected 0x%04x\n", gStkPaste.crc, gStkPaste.expCrc);
+        stk_pasteAbort();
+        return false;
+    }
+
+    // Slots past numBlks were not on the sticker, so they are empty
+    stk_zeroTail(gStkPaste.numBlks);
+
+    stk_commitRamFlash();
+    stk_dbIndexInit();
+
+    return true;
+}
+//------------------------------------------------
+//             end STREAMING PASTE
+//------------------------------------------------
+
+
+//------------------------------------------------
+//                 ACCESS LOG
+//------------------------------------------------
+//
+// Each tap appends one 8-byte record to a ring of flash sectors.  Records
+// hold the DB slot instead of the UID and the time as a delta from the
+// previous record, with a STK_LOG_RESULT_TIME_SYNC record carrying the full
+// RTC value at boot and whenever the delta would overflow.
+//
+// An append is a single record program: it never erases or rewrites a
+// page.  stk_logService(), run from the main loop when idle, keeps the
+// sector after the head erased, so wear moves round all the sectors.
+// (If the head gets there first, the append does the erase itself.)
+//
+// The host decodes a read-out by walking records oldest first:
+//     TIME_SYNC:  time  = (slot << 16) | rtcDelta
+//     otherwise:  time += rtcDelta
+//
+#define STK_LOG_RESULT_ALLOWED    (0x01U)
+#define STK_LOG_RESULT_DENIED     (0x02U)
+#define STK_LOG_RESULT_FUNCTION   (0x03U) // A function sticker was handled
+#define STK_LOG_RESULT_TIME_SYNC  (0x7FU)
+#define STK_LOG_SLOT_NONE         (0xFFFFU)
+
+typedef struct __attribute__((__packed__))
+{
+    uint16_t seq;       // Wraps; erased flash reads 0xFFFF
+    uint16_t slot;      // DB slot, STK_LOG_SLOT_NONE if not in the DB
+    uint16_t rtcDelta;  // Seconds since the previous record
+    uint8_t  function;  // stk_function of the sticker
+    uint8_t  result;    // STK_LOG_RESULT_*
+} stk_log_rec;
+ct_assert(sizeof(stk_log_rec)==STK_LOG_REC_LEN);
+ct_assert(STK_LOG_NUM_RECS < 0x8000); // Sequence numbers compare with wrap
+ct_assert((STK_LOG_SECTOR_LEN % STK_LOG_REC_LEN) == 0);
+ct_assert(STK_LOG_NUM_SECTORS >= 3);  // Head sector + one erased ahead + history
+
+static bool stk_logReadRec(uint16_t n, stk_log_rec *rec)
+{
+    return stk_logFlashRead((uint32_t)n * STK_LOG_REC_LEN, (uint8_t *)rec, STK_LOG_REC_LEN);
+}
+
+static bool stk_logRecIsErased(stk_log_rec *rec)
+{
+    return (rec->seq == 0xFFFFU) && (rec->slot == 0xFFFFU) && (rec->result == 0xFFU);
+}
+
+// A record we wrote, as opposed to erased or never-erased (virgin) flash
+static bool stk_logRecIsValid(stk_log_rec *rec)
+{
+    return (rec->seq != 0xFFFFU) &&
+           ( (rec->result == STK_LOG_RESULT_ALLOWED)  ||
+             (rec->result == STK_LOG_RESULT_DENIED)   ||
+             (rec->result == STK_LOG_RESULT_FUNCTION) ||
+             (rec->result == STK_LOG_RESULT_TIME_SYNC) );
+}
+
+// Sequence numbers run 0..0xFFFE.  true if b was written after a.
+static bool stk_logSeqAfter(uint16_t a, uint16_t b)
+{
+    uint16_t ldist = (uint16_t)(((uint32_t)b + 0xFFFFU - a) % 0xFFFFU);
+    return (ldist != 0) && (ldist < 0x8000U);
+}
+
+// The sector the head moves into next, i.e. the one that has to be erased
+// before then
+static int16_t stk_logUpcomingSector(void)
+{
+    int16_t lsector = (int16_t)(gStkLog.head / STK_LOG_RECS_PER_SECTOR);
+
+    if ((gStkLog.head % STK_LOG_RECS_PER_SECTOR) == 0) {
+        return lsector;
+    }
+    return (int16_t)((lsector + 1) % STK_LOG_NUM_SECTORS);
+}
+
+static bool stk_logWrite(uint16_t slot, uint16_t rtcDelta, uint8_t function, uint8_t result)
+{
+    stk_log_rec lrec;
+    bool lnewSector = ((gStkLog.head % STK_LOG_RECS_PER_SECTOR) == 0);
+
+    // Entering a new sector: it must be erased before the first record
+    if (lnewSector && (gStkLog.erasedSector != stk_logUpcomingSector())) {
+        if (!stk_logFlashErase(gStkLog.head / STK_LOG_RECS_PER_SECTOR)) {
+            return false;
+        }
+    }
+
+    lrec.seq      = gStkLog.seq;
+    lrec.slot     = slot;
+    lrec.rtcDelta = rtcDelta;
+    lrec.function = function;
+    lrec.result   = result;
+    if (!stk_logFlashWrite((uint32_t)gStkLog.head * STK_LOG_REC_LEN, (uint8_t *)&lrec, STK_LOG_REC_LEN)) {
+        return false;
+    }
+
+    if (lnewSector) {
+        gStkLog.erasedSector = -1;
+    }
+    gStkLog.head = (uint16_t)((gStkLog.head + 1) % STK_LOG_NUM_RECS);
+    gStkLog.seq++;
+    if (gStkLog.seq == 0xFFFFU) {
+        gStkLog.seq = 0;
+    }
+
+    return true;
+}
+
+static bool stk_logTimeSync(uint32_t now)
+{
+    gStkLog.lastTime = now;
+    return stk_logWrite((uint16_t)(now >> 16), (uint16_t)now, STKFUNC_UNDEFINED, STK_LOG_RESULT_TIME_SYNC);
+}
+
+//
+// Find the head of the log.  Call once at boot.
+//
+void stk_logInit(void)
+{
+    uint16_t n = 0;
+    stk_log_rec lrec;
+    uint16_t lnewestSeq = 0;
+    bool lfound = false;
+
+    memset((uint8_t *)&gStkLog, 0, sizeof(gStkLog));
+    gStkLog.erasedSector = -1;
+
+    // The head follows the newest record.  All real records are within
+    // STK_LOG_NUM_RECS (< half the sequence space) of each other, so a
+    // running wrap-aware max finds it, whatever is in sectors the ring
+    // hasn't reached yet.
+    for (n = 0; n < STK_LOG_NUM_RECS; n++) {
+        if (!stk_logReadRec(n, &lrec)) {
+            break;
+        }
+        if ( stk_logRecIsValid(&lrec) &&
+             (!lfound || stk_logSeqAfter(lnewestSeq, lrec.seq)) )
+        {
+            lnewestSeq   = lrec.seq;
+            gStkLog.head = (uint16_t)((n + 1) % STK_LOG_NUM_RECS);
+            lfound = true;
+        }
+    }
+    if (lfound) {
+        gStkLog.seq = (lnewestSeq == 0xFFFEU) ? 0 : (uint16_t)(lnewestSeq + 1);
+    }
+
+    // Not erased after the newest record (corrupt or never-erased flash):
+    // start again at the next sector, which gets erased before it is written
+    if ( ((gStkLog.head % STK_LOG_RECS_PER_SECTOR) != 0) &&
+         stk_logReadRec(gStkLog.head, &lrec) && !stk_logRecIsErased(&lrec) )
+    {
+        gStkLog.head = (uint16_t)((((gStkLog.head / STK_LOG_RECS_PER_SECTOR) + 1) % STK_LOG_NUM_SECTORS) *
+                                  STK_LOG_RECS_PER_SECTOR);
+    }
+
+    stk_logTimeSync(stk_rtcGetSeconds());
+}
+
+//
+// Append a tap to the log.  slot is gStkLastSlot for user stickers.
+//
+bool stk_logAppend(int slot, stk_function function, uint8_t result)
+{
+    uint32_t lnow   = stk_rtcGetSeconds();
+    uint32_t ldelta = lnow - gStkLog.lastTime;
+
+    if (ldelta > 0xFFFFU) {
+        if (!stk_logTimeSync(lnow)) {
+            return false;
+        }
+        ldelta = 0;
+    }
+    gStkLog.lastTime = lnow;
+
+    return stk_logWrite((slot < 0) ? STK_LOG_SLOT_NONE : (uint16_t)slot,
+                        (uint16_t)ldelta, function, result);
+}
+
+//
+// Erase the sector after the head ahead of time, so appends never have to.
+// Call from the main loop when idle.
+//
+void stk_logService(void)
+{
+    int16_t lsector = stk_logUpcomingSector();
+
+    if (gStkLog.erasedSector == lsector) {
+        return;
+    }
+
+    if (stk_logFlashErase((uint16_t)lsector)) {
+        gStkLog.erasedSector = lsector;
+    }
+}
+
+//
+// Bulk read-out for STKFUNC_GET_ACCESS_LOGS: copy up to maxRecs records into
+// buf, oldest first.  *cursor starts at 0 and is advanced so repeated calls
+// continue where the last one stopped.  Returns the number of records
+// copied; 0 once the head has been reached.
+//
+uint16_t stk_logRead(uint16_t *cursor, uint8_t *buf, uint16_t maxRecs)
+{
+    uint16_t lcopied = 0;
+
+    // The oldest records start at the sector after the head's (everything
+    // from there round to the head is in order)
+    uint16_t loldest = (uint16_t)((((gStkLog.head / STK_LOG_RECS_PER_SECTOR) + 1) % STK_LOG_NUM_SECTORS) *
+                                  STK_LOG_RECS_PER_SECTOR);
+
+    while ( (*cursor < STK_LOG_NUM_RECS) && (lcopied < maxRecs) ) {
+        uint16_t lrecNum = (uint16_t)((loldest + *cursor) % STK_LOG_NUM_RECS);
+        stk_log_rec *lrec = (stk_log_rec *)&buf[lcopied * STK_LOG_REC_LEN];
+
+        if (lrecNum == gStkLog.head) {
+            *cursor = STK_LOG_NUM_RECS;
+            break;
+        }
+        (*cursor)++;
+
+        // Sectors erased ahead of the head have no records yet, and sectors
+        // the ring hasn't reached may hold anything
+        if (stk_logReadRec(lrecNum, lrec) && stk_logRecIsValid(lrec)) {
+            lcopied++;
+        }
+    }
+
+    return lcopied;
+}
+//------------------------------------------------
+//               end ACCESS LOG
+//------------------------------------------------
+
+
+//------------------------------------------------
+//               BULK STICKER READS
+//------------------------------------------------
+
+// First block of cp_ofd on a STKFUNC_CONFIG_PAYLOAD sticker
+#define STK_CP_OFD_START_BLOCK  (STK_DATA_START_BLOCK + (STK_ONSTICK_DATA_LEN / NFCV_BLOCK_LEN))
+
+//
+// The UID to address reads of nfcDev to.  Every read after detection goes to
+// the tag being handled, so other tags in the field (see MULTI-TAG FIELD),
+// or one that took its place, can't answer it.  The UID costs 8 request
+// bytes, ~2.4 ms at 1 out of 4 coding, per command.  NULL (unaddressed) only
+// if nfcDev has no NFC-V UID.
+//
+static const uint8_t *stk_nfcDevAddr(const rfalNfcDevice *nfcDev)
+{
+    if ( (nfcDev == NULL) || (nfcDev->nfcid == NULL) || (nfcDev->nfcidLen != RFAL_NFCV_UID_LEN) ) {
+        return NULL;
+    }
+
+    return nfcDev->nfcid;
+}
+
+//
+// Read numBlocks (<= NFCV_RMB_MAX_BLOCKS) blocks starting at firstBlock with
+// one Read Multiple Blocks command to addr (see stk_nfcDevAddr()), retrying
+// just this chunk on failure.  Block numbers past 255 need the extended
+// command.  Returns a pointer to the block data inside rxBuf, or NULL.
+//
+static uint8_t *stk_readBlocks(const uint8_t *addr, uint16_t firstBlock, uint16_t numBlocks,
+                               uint8_t *rxBuf)
+{
+    ReturnCode err = ERR_NONE;
+    uint16_t   rcvLen = 0;
+    int        ltry = 0;
+
+    assert_param((numBlocks > 0) && (numBlocks <= NFCV_RMB_MAX_BLOCKS));
+
+    for (ltry = 0; ltry < NFCV_RMB_RETRIES; ltry++) {
+        // numOfBlocks is the raw ISO15693 field, i.e. number of blocks - 1
+        if ((firstBlock + numBlocks - 1) <= 0xFF) {
+            err = rfalNfcvPollerReadMultipleBlocks(RFAL_NFCV_REQ_FLAG_DEFAULT, addr,
+                                                   (uint8_t)firstBlock, (uint8_t)(numBlocks - 1),
+                                                   rxBuf, NFCV_RMB_BUF_LEN, &rcvLen);
+        } else {
+            err = rfalNfcvPollerExtendedReadMultipleBlocks(RFAL_NFCV_REQ_FLAG_DEFAULT, addr,
+                                                           firstBlock, (uint16_t)(numBlocks - 1),
+                                                           rxBuf, NFCV_RMB_BUF_LEN, &rcvLen);
+        }
+
+        // See NFCV_READ_RET_LEN: rcvLen is flags + data, without the CRC
+        if ( (err == ERR_NONE) &&
+             (rcvLen >= (1 + (numBlocks * NFCV_BLOCK_LEN))) )
+        {
+            return &rxBuf[1];
+        }
+
+        platformLog("RMB blk %d x%d failed (%d), try %d\n", firstBlock, numBlocks, err, ltry);
+    }
+
+    return NULL;
+}
+
+//
+// Chunked read of consecutive STK_DB_ENTRY_SIZE members of a payload
+// sticker's cp_ofd (member 0 starts at STK_CP_OFD_START_BLOCK), for the
+// delta and spanned payloads:
+//
+//     stk_readMembersBegin(&lrd, nfcDev, first, num);
+//     while ((ldata = stk_readMembers(&lrd, &lnum)) != NULL) {
+//         use the lnum members at ldata
+//     }
+//     all read if lrd.member == lrd.end, lrd.crc is over all of them
+//
+#define STK_BLKS_PER_MEMBER   (STK_DB_ENTRY_SIZE / NFCV_BLOCK_LEN)
+#define STK_MEMBERS_PER_READ  (NFCV_RMB_MAX_BLOCKS / STK_BLKS_PER_MEMBER)
+
+typedef struct {
+    const uint8_t *addr; // stk_nfcDevAddr() of the sticker
+    uint16_t  member;  // Next member to read
+    uint16_t  end;     // One past the last
+    stk_crc16 crc;     // Over the members returned so far
+    uint8_t   rxBuf[NFCV_RMB_BUF_LEN];
+} stk_member_reader;
+
+static void stk_readMembersBegin(stk_member_reader *rd, const rfalNfcDevice *nfcDev,
+                                 uint16_t first, uint16_t num)
+{
+    rd->addr   = stk_nfcDevAddr(nfcDev);
+    rd->member = first;
+    rd->end    = first + num;
+    rd->crc    = stk_crc16Init();
+}
+
+// The next (up to STK_MEMBERS_PER_READ) members, one Read Multiple Blocks.
+// NULL once all have been read, or if the read failed.
+static const uint8_t *stk_readMembers(stk_member_reader *rd, uint16_t *num)
+{
+    uint16_t lnum = rd->end - rd->member;
+    const uint8_t *ldata = NULL;
+
+    if (lnum == 0) {
+        return NULL;
+    }
+    if (lnum > STK_MEMBERS_PER_READ) {
+        lnum = STK_MEMBERS_PER_READ;
+    }
+
+    ldata = stk_readBlocks(rd->addr, STK_CP_OFD_START_BLOCK + (rd->member * STK_BLKS_PER_MEMBER),
+                           lnum * STK_BLKS_PER_MEMBER, rd->rxBuf);
+    if (ldata == NULL) {
+        return NULL;
+    }
+
+    rd->crc     = stk_crc16Update(rd->crc, ldata, lnum * STK_DB_ENTRY_SIZE);
+    rd->member += lnum;
+    *num = lnum;
+
+    return ldata;
+}
+
+//
+// Adaptive read of a sticker's stk_data.
+//
+// 99% of taps only need stk_dat_always, so by default that is all that is
+// read (one Read Single Block).  Backup stickers and the like need more,
+// which used to mean a second round trip.  When at least
+// STK_SPEC_READ_THRESHOLD of the last 8 taps needed more, the always block
+// and the longest payload any function has are fetched speculatively in one
+// Read Multiple Blocks instead.  Admin sessions (backup stickers in a row)
+// get one round trip per tap; ordinary user taps are unaffected.
+//
+#define STK_SPEC_READ_LEN        (STK_BACKUP_LENV2)
+#define STK_SPEC_READ_BLOCKS     (STK_SPEC_READ_LEN / NFCV_BLOCK_LEN)
+#define STK_SPEC_READ_THRESHOLD  (2)
+#define STK_FUNC_FITS_SPEC(function, size)  && ((size) <= STK_SPEC_READ_LEN)
+ct_assert(1 STK_FUNCTION_TABLE(STK_FUNC_FITS_SPEC)); // Every function fits one read
+
+// The stk_dat_always stk_fieldInventory() already read, if nfcDev is one of
+// gStkField[] (valid until the next inventory)
+static const stk_dat_always *stk_fieldPrefetched(const rfalNfcDevice *nfcDev)
+{
+    uint8_t i = 0;
+
+    for (i = 0; i < gStkFieldCnt; i++) {
+        if ( (nfcDev == &gStkField[i].dev) && gStkField[i].alwaysOk ) {
+            return &gStkField[i].always;
+        }
+    }
+
+    return NULL;
+}
+
+// The RF part of stk_readStickerData()
+static bool stk_readStickerDataRF(const uint8_t *addr, const stk_dat_always *prefetched,
+                                  stk_data *dat)
+{
+    uint8_t  lrxBuf[NFCV_RMB_BUF_LEN];
+    uint8_t *ldata = NULL;
+    uint16_t lhave = 0;   // Bytes of dat already read
+    uint16_t lneed = STK_DAT_ALWAYS_LEN;
+    int      lrecent = __builtin_popcount(gStkReadHist);
+
+    memset((uint8_t *)dat, 0, sizeof(stk_data));
+    gStkReadTaps++;
+
+    if (prefetched != NULL) {
+        memcpy((uint8_t *)dat, (const uint8_t *)prefetched, STK_DAT_ALWAYS_LEN);
+        lhave = STK_DAT_ALWAYS_LEN;
+    } else if (lrecent >= STK_SPEC_READ_THRESHOLD) {
+        gStkReadTxns++;
+        ldata = stk_readBlocks(addr, STK_DATA_START_BLOCK, STK_SPEC_READ_BLOCKS, lrxBuf);
+        if (ldata == NULL) {
+            return false;
+        }
+        memcpy((uint8_t *)dat, ldata, STK_SPEC_READ_LEN);
+        lhave = STK_SPEC_READ_LEN;
+    } else {
+        uint16_t rcvLen = 0;
+        gStkReadTxns++;
+        if ( (rfalNfcvPollerReadSingleBlock(RFAL_NFCV_REQ_FLAG_DEFAULT, addr, STK_DATA_START_BLOCK,
+                                            lrxBuf, NFCV_READ_BLOCK_LEN, &rcvLen) != ERR_NONE) ||
+             (rcvLen != NFCV_READ_RET_LEN) )
+        {
+            return false;
+        }
+        memcpy((uint8_t *)dat, &lrxBuf[1], STK_DAT_ALWAYS_LEN);
+        lhave = STK_DAT_ALWAYS_LEN;
+    }
+
+    const stk_data_size *linfo = stk_funcInfo(dat->always.function);
+    if (linfo != NULL) {
+        lneed = linfo->size;
+    }
+
+    gStkReadHist <<= 1;
+    if (lneed > STK_DAT_ALWAYS_LEN) {
+        gStkReadHist |= 1U;
+    } else if (lhave > STK_DAT_ALWAYS_LEN) {
+        gStkReadSpecWasted++;
+    }
+
+    if (lneed > lhave) {
+        gStkReadTxns++;
+        ldata = stk_readBlocks(addr, STK_DATA_START_BLOCK + (lhave / NFCV_BLOCK_LEN),
+                               (lneed - lhave) / NFCV_BLOCK_LEN, lrxBuf);
+        if (ldata == NULL) {
+            return false;
+        }
+        memcpy(((uint8_t *)dat) + lhave, ldata, lneed - lhave);
+    }
+
+    return true;
+}
+
+//
+// Read the stk_data of nfcDev, the sticker in the field: stk_dat_always plus
+// however much payload its function has (see gDataSizeArray).  Returns false
+// if the read failed.  The caller still validates version/CRC as before.
+//
+// For a tag from stk_fieldInventory() (&gStkField[i].dev) the prefetched
+// stk_dat_always is used, so only a longer payload costs an RF command.
+//
+bool stk_readStickerData(rfalNfcDevice *nfcDev, stk_data *dat)
+{
+    uint32_t t = stk_statStart();
+    bool lok = stk_readStickerDataRF(stk_nfcDevAddr(nfcDev), stk_fieldPrefetched(nfcDev), dat);
+
+    stk_statStop(STK_STAGE_ALWAYS_READ, t);
+    stk_pollRecordTap(stk_nfcDevUid(nfcDev));
+    if (!lok) {
+        gStkReadFails++;
+    }
+
+    return lok;
+}
+
+//
+// Read the cp_ofd part of a config payload sticker in NFCV_RMB_MAX_BLOCKS
+// chunks and stream it into the paste pipeline.  Only the numBlks members the
+// payload actually uses are read.  A chunk that still fails after its retries
+// aborts the paste (nothing is committed).
+//
+// Pages whose CRC in the payload's digest matches ours are not read at all;
+// our own copy of the page is fed instead.  If a page only looked the same
+// (e.g. the source changed after its last stk_dbDigest()), the payload CRC
+// catches it and the payload is read again in full.
+//
+#define STK_PAGE_BLKS  ((STK_PAGE_MEMBERS * STK_DB_ENTRY_SIZE) / NFCV_BLOCK_LEN)
+ct_assert((STK_PAGE_BLKS % NFCV_RMB_MAX_BLOCKS) == 0); // Chunks never straddle pages
+
+static bool stk_pasteCanSkipPage(int p)
+{
+    stk_db_digest *ldig = &gStkPaste.srcDigest;
+
+    return (p > 0) &&
+           (p < STK_NUM_PAGES) &&
+           (((p + 1) * STK_PAGE_MEMBERS) <= gStkPaste.numBlks) &&
+           (ldig->version  == STK_DIGEST_VERSION) &&
+           (ldig->numPages == STK_NUM_PAGES) &&
+           (ldig->page[p - 1] == gStkPageCrc[p]);
+}
+
+// One read of the payload.  *readOk is false if the sticker could not be
+// read (as opposed to being read and rejected).
+static bool stk_readConfigPayloadPass(const uint8_t *addr, bool allowSkip, uint16_t *skipped,
+                                      bool *readOk)
+{
+    uint8_t  lrxBuf[NFCV_RMB_BUF_LEN];
+    uint16_t lblk = STK_CP_OFD_START_BLOCK;
+    uint16_t lneed = 0;
+    uint16_t lskipped = 0;
+
+    *readOk  = false;
+    *skipped = 0;
+
+    stk_pageCrcRefresh(); // For stk_pasteCanSkipPage()
+    if (!stk_pasteBegin()) {
+        return false;
+    }
+
+    while ((lneed = stk_pasteBytesNeeded()) > 0) {
+        if ( allowSkip &&
+             (gStkPaste.numBlks != 0) &&
+             ((gStkPaste.offset % (STK_PAGE_MEMBERS * STK_DB_ENTRY_SIZE)) == 0) )
+        {
+            int p = gStkPaste.offset / (STK_PAGE_MEMBERS * STK_DB_ENTRY_SIZE);
+            if (stk_pasteCanSkipPage(p)) {
+                stk_pasteFeed((uint8_t *)&gSRF[p * STK_PAGE_MEMBERS],
+                              STK_PAGE_MEMBERS * STK_DB_ENTRY_SIZE);
+                lblk += STK_PAGE_BLKS;
+                lskipped++;
+                continue;
+            }
+        }
+
+        // Until op_mode has been read we don't know numBlks, so read a full
+        // chunk; stk_pasteFeed() ignores anything past the end.
+        uint16_t lnum = (lneed + NFCV_BLOCK_LEN - 1) / NFCV_BLOCK_LEN;
+        if ( (lnum > NFCV_RMB_MAX_BLOCKS) || (gStkPaste.numBlks == 0) ) {
+            lnum = NFCV_RMB_MAX_BLOCKS;
+        }
+
+        uint8_t *ldata = stk_readBlocks(addr, lblk, lnum, lrxBuf);
+        if (ldata == NULL) {
+            stk_pasteAbort();
+            return false;
+        }
+        if (!stk_pasteFeed(ldata, lnum * NFCV_BLOCK_LEN)) {
+            *readOk = true;
+            stk_pasteAbort();
+            return false;
+        }
+
+        lblk += lnum;
+    }
+
+    platformLog("Paste: %d unchanged pages not read\n", lskipped);
+
+    *readOk  = true;
+    *skipped = lskipped;
+    return stk_pasteFinish();
+}
+
+bool stk_readConfigPayload(rfalNfcDevice *nfcDev)
+{
+    const uint8_t *laddr = stk_nfcDevAddr(nfcDev);
+    uint16_t lskipped = 0;
+    bool lreadOk = false;
+
+    if (stk_readConfigPayloadPass(laddr, true, &lskipped, &lreadOk)) {
+        return true;
+    }
+
+    // The source's digest only describes its DB as of its last
+    // stk_dbDigest().  If it changed since, a skipped page was wrong and the
+    // CRC will fail every time, so read everything once more.
+    if (lreadOk && (lskipped > 0)) {
+        platformLog("Paste: CRC failed with %d pages skipped, reading all\n", lskipped);
+        return stk_readConfigPayloadPass(laddr, false, &lskipped, &lreadOk);
+    }
+
+    return false;
+}
+//------------------------------------------------
+//             end BULK STICKER READS
+//------------------------------------------------
+
+
+//------------------------------------------------
+//               DELTA PAYLOADS
+//------------------------------------------------
+//
+// A STKFUNC_CONFIG_DELTA_PAYLOAD sticker carries a list of add/remove
+// operations instead of a full stk_onflash_data image.  After the usual
+// cp_dat, it has one stk_delta_hdr and then numOps stk_delta_op members:
+//
+//     revoke one lost sticker: 32 + 12 + 12 = 56 bytes   (vs 4016)
+//
+// The ops are only valid against the DB they were made for (baseCrc, see
+// stk_dbCrc()).  They are applied through the same add/remove code as a
+// master session, and like a paste they are all-or-nothing: nothing is
+// committed to flash unless every op applied and the op CRC matched.
+//
+#define STK_DELTA_VERSION    (1)
+#define STK_DELTA_OP_ADD     (0x01U)
+#define STK_DELTA_OP_REMOVE  (0x02U)
+#define STK_DELTA_MAX_OPS    (STK_ONFLASH_ENTRIES * 2)
+
+typedef struct __attribute__((__packed__))
+{
+    uint8_t  version;   // STK_DELTA_VERSION
+    uint16_t numOps;
+    uint16_t baseCrc;   // stk_dbCrc() of the DB the ops apply to
+    uint16_t crc;       // CRC16-CCITT over the numOps ops
+    uint8_t  rfu[5];
+} stk_delta_hdr;
+ct_assert(sizeof(stk_delta_hdr)==STK_DB_ENTRY_SIZE);
+
+typedef struct __attribute__((__packed__))
+{
+    uint8_t  meta1_truST25_mast; // STK_ENTRY_META1_* for adds
+    uint8_t  op;                 // STK_DELTA_OP_*
+    uint8_t  opRFU3;
+    uint8_t  opRFU4;
+    uint64_t uid;
+} stk_delta_op;
+ct_assert(sizeof(stk_delta_op)==STK_DB_ENTRY_SIZE);
+
+static bool stk_deltaApplyOp(const stk_delta_op *lop)
+{
+    if (lop->uid == 0) {
+        return false;
+    }
+
+    switch (lop->op) {
+        case STK_DELTA_OP_ADD:
+            return stk_dbAddUid(lop->uid,
+                                (lop->meta1_truST25_mast & STK_ENTRY_META1_ISTRUST25) != 0,
+                                (lop->meta1_truST25_mast & STK_ENTRY_META1_ISMASTER)  != 0);
+        case STK_DELTA_OP_REMOVE:
+            // Already gone is fine
+            stk_dbRemoveUid(lop->uid);
+            return true;
+        default:
+            return false;
+    }
+}
+
+//
+// Read a delta payload sticker and apply it.  Returns false, leaving the DB
+// untouched, if the sticker is for a different base DB, is malformed, or
+// could not be read completely.
+//
+bool stk_readDeltaPayload(rfalNfcDevice *nfcDev)
+{
+    stk_member_reader lrd;
+    const uint8_t *ldata = NULL;
+    uint16_t lnum = 0;
+    uint16_t ldone = 0;
+    stk_delta_hdr lhdr;
+
+    stk_readMembersBegin(&lrd, nfcDev, 0, 1);
+    ldata = stk_readMembers(&lrd, &lnum);
+    if (ldata == NULL) {
+        return false;
+    }
+    memcpy((uint8_t *)&lhdr, ldata, sizeof(lhdr));
+
+    if ( (lhdr.version != STK_DELTA_VERSION) ||
+         (lhdr.numOps > STK_DELTA_MAX_OPS) )
+    {
+        platformLog("Delta: bad header v%d numOps %d\n", lhdr.version, lhdr.numOps);
+        return false;
+    }
+
+    // A delta replaces a half-finished spanned payload (its base is the
+    // committed DB, not a partly applied one)
+    stk_spanAbort();
+    if (lhdr.baseCrc != stk_dbCrc()) {
+        platformLog("Delta: base CRC 0x%04x, ours 0x%04x\n", lhdr.baseCrc, stk_dbCrc());
+        return false;
+    }
+
+    // Everything dirty from here on belongs to the delta
+    stk_commitRamFlash();
+    if (stk_isDirty()) {
+        // Failed EEPROM write: a revert would take those changes with it
+        platformLog("Delta refused: uncommitted changes\n");
+        return false;
+    }
+
+    stk_readMembersBegin(&lrd, nfcDev, 1, lhdr.numOps);
+    while ((ldata = stk_readMembers(&lrd, &lnum)) != NULL) {
+        uint16_t i = 0;
+
+        for (i = 0; i < lnum; i++) {
+            stk_delta_op lop;
+            memcpy((uint8_t *)&lop, &ldata[i * STK_DB_ENTRY_SIZE], sizeof(lop));
+            if (!stk_deltaApplyOp(&lop)) {
+                platformLog("Delta: op %d failed\n", ldone + i);
+                break;
+            }
+        }
+        if (i != lnum) {
+            break;
+        }
+
+        ldone += lnum;
+    }
+
+    if ( (ldone != lhdr.numOps) || (stk_crc16Final(lrd.crc) != lhdr.crc) ) {
+        platformLog("Delta failed: %d/%d ops, CRC 0x%04x expected 0x%04x\n",
+                    ldone, lhdr.numOps, stk_crc16Final(lrd.crc), lhdr.crc);
+        stk_revertRamFlash();
+        stk_dbIndexInit();
+        return false;
+    }
+
+    stk_commitRamFlash();
+    return true;
+}
+//------------------------------------------------
+//             end DELTA PAYLOADS
+//------------------------------------------------
+
+
+//------------------------------------------------
+//              SPANNED PAYLOADS
+//------------------------------------------------
+//
+// A DB image too big for one sticker is split across up to
+// STK_SPAN_MAX_CHUNKS STKFUNC_CONFIG_SPAN_PAYLOAD stickers.  After the usual
+// cp_dat, each one has a stk_span_hdr and then numMembers stk_onflash_data
+// members starting at firstMember:
+//
+//     sticker 1/3:  hdr  members   1..110
+//     sticker 2/3:  hdr  members 111..220
+//     sticker 3/3:  hdr  members 221..331
+//
+// Chunks can be tapped in any order and each one is applied to gStkRamFlash
+// as soon as it is read and its own CRC checks out.  gStkSpan only keeps a
+// bit per chunk, so a pulled sticker, or a master session that timed out,
+// just means tapping the rest later.  Like a paste, only master1 and
+// entries[] are taken, and nothing is committed until every chunk is in and
+// the result has the stk_dbCrc() the header promised.  A transfer with no
+// new chunk for STK_SPAN_TIMEOUT_SEC is dropped by stk_spanIsOpen().
+//
+// While a span is open gStkRamFlash is neither the old DB nor the new one,
+// and the UID index, mirror and bloom filter still describe the old one.  So
+// until it completes or is dropped:
+//     - taps are checked against the committed DB: stk_isInDB() and
+//       stk_bkupIsInDB() go through the index, and isTheSame() is shown the
+//       committed member (see stk_slotIsTheSame())
+//     - stk_commitRamFlash() refuses, so nothing else commits the chunks
+//     - adds and removes refuse
+//     - a paste or delta aborts it first
+// stk_spanIsOpen() tells the caller, e.g. to show "transfer in progress".
+//
+#define STK_SPAN_VERSION  (1)
+
+typedef struct __attribute__((__packed__))
+{
+    uint8_t  version;     // STK_SPAN_VERSION
+    uint8_t  seq;         // 0..total-1
+    uint8_t  total;       // Number of chunks (stickers)
+    uint8_t  rfu;
+    uint16_t dbCrc;       // stk_dbCrc() of the complete DB, same on every chunk
+    uint16_t firstMember; // stk_onflash_data member of the first one on this sticker
+    uint16_t numMembers;
+    uint16_t crc;         // CRC16-CCITT over this chunk's members
+} stk_span_hdr;
+ct_assert(sizeof(stk_span_hdr)==STK_DB_ENTRY_SIZE);
+ct_assert(STK_SPAN_MAX_CHUNKS <= 32);
+
+bool stk_spanIsOpen(void)
+{
+    if ( (gStkSpan.total != 0) &&
+         ((stk_rtcGetSeconds() - gStkSpan.lastSec) > STK_SPAN_TIMEOUT_SEC) )
+    {
+        platformLog("Span: 0x%04x timed out\n", gStkSpan.dbCrc);
+        stk_spanAbort();
+    }
+
+    return (gStkSpan.total != 0);
+}
+
+void stk_spanAbort(void)
+{
+    if (gStkSpan.total != 0) {
+        stk_revertRamFlash();
+        stk_dbIndexInit();
+    }
+    memset((uint8_t *)&gStkSpan, 0, sizeof(gStkSpan));
+}
+
+// Read this sticker's members into gStkRamFlash.  Returns true if they were
+// all read and the chunk CRC matched.
+static bool stk_spanApplyChunk(rfalNfcDevice *nfcDev, const stk_span_hdr *lhdr)
+{
+    stk_member_reader lrd;
+    const uint8_t *ldata = NULL;
+    uint16_t lnum = 0;
+    uint16_t lmember = lhdr->firstMember;
+
+    // The members follow the header on the sticker
+    stk_readMembersBegin(&lrd, nfcDev, 1, lhdr->numMembers);
+    while ((ldata = stk_readMembers(&lrd, &lnum)) != NULL) {
+        uint16_t i = 0;
+
+        for (i = 0; i < lnum; i++, lmember++) {
+            const uint8_t *lsrc = &ldata[i * STK_DB_ENTRY_SIZE];
+            if ( ((lmember == IDX_master1) || (lmember >= IDX_uids)) &&
+                 (memcmp((uint8_t *)&gSRF[lmember], lsrc, STK_DB_ENTRY_SIZE) != 0) )
+            {
+                memcpy((uint8_t *)&gSRF[lmember], lsrc, STK_DB_ENTRY_SIZE);
+                stk_markDirty(IDX_op_mode, lmember);
+            }
+        }
+    }
+
+    // A bad chunk leaves its range half written, but its bit stays clear and
+    // the range is rewritten when the sticker is tapped again
+    return (lrd.member == lrd.end) && (stk_crc16Final(lrd.crc) == lhdr->crc);
+}
+
+//
+// Read a spanned payload sticker.  Returns false if the sticker was rejected
+// or could not be read (tap it again).  Otherwise *remaining is the number
+// of chunks still missing; 0 means the new DB has been applied.
+//
+bool stk_readSpanPayload(rfalNfcDevice *nfcDev, uint8_t *remaining)
+{
+    stk_member_reader lrd;
+    const uint8_t *ldata = NULL;
+    uint16_t lnum = 0;
+    stk_span_hdr lhdr;
+
+    assert_param(remaining != NULL);
+    *remaining = (uint8_t)(gStkSpan.total - __builtin_popcount(gStkSpan.done));
+
+    stk_readMembersBegin(&lrd, nfcDev, 0, 1);
+    ldata = stk_readMembers(&lrd, &lnum);
+    if (ldata == NULL) {
+        return false;
+    }
+    memcpy((uint8_t *)&lhdr, ldata, sizeof(lhdr));
+
+    if ( (lhdr.version != STK_SPAN_VERSION) ||
+         (lhdr.total == 0) || (lhdr.total > STK_SPAN_MAX_CHUNKS) ||
+         (lhdr.seq >= lhdr.total) ||
+         (lhdr.firstMember <= IDX_op_mode) || (lhdr.numMembers == 0) ||
+         ((lhdr.firstMember + lhdr.numMembers) > STK_ONFLASH_NUM_MEMBERS) )
+    {
+        platformLog("Span: bad header v%d %d/%d\n", lhdr.version, lhdr.seq, lhdr.total);
+        return false;
+    }
+
+    // A chunk of a different transfer starts over
+    if ( (gStkSpan.total != 0) &&
+         ((gStkSpan.dbCrc != lhdr.dbCrc) || (gStkSpan.total != lhdr.total)) )
+    {
+        platformLog("Span: new transfer 0x%04x replaces 0x%04x\n", lhdr.dbCrc, gStkSpan.dbCrc);
+        stk_spanAbort();
+    }
+    if (gStkSpan.total == 0) {
+        // Everything dirty from here on belongs to the transfer
+        stk_commitRamFlash();
+        if (stk_isDirty()) {
+            // Failed EEPROM write: the transfer could not be told apart from it
+            return false;
+        }
+        // Taps use the index until the span is done, it must be complete
+        stk_dbIndexEnsure();
+        gStkSpan.total   = lhdr.total;
+        gStkSpan.dbCrc   = lhdr.dbCrc;
+        gStkSpan.lastSec = stk_rtcGetSeconds();
+    }
+
+    if ((gStkSpan.done & (1UL << lhdr.seq)) == 0) {
+        if (!stk_spanApplyChunk(nfcDev, &lhdr)) {
+            platformLog("Span: chunk %d/%d failed\n", lhdr.seq + 1, lhdr.total);
+            return false;
+        }
+        gStkSpan.done |= (1UL << lhdr.seq);
+        gStkSpan.lastSec = stk_rtcGetSeconds();
+        if ((lhdr.firstMember + lhdr.numMembers) > gStkSpan.numBlks) {
+            gStkSpan.numBlks = lhdr.firstMember + lhdr.numMembers;
+        }
+    }
+
+    *remaining = (uint8_t)(gStkSpan.total - __builtin_popcount(gStkSpan.done));
+    platformLog("Span: chunk %d/%d, %d to go\n", lhdr.seq + 1, lhdr.total, *remaining);
+    if (*remaining != 0) {
+        return true;
+    }
+
+    // Slots past the last chunk were not sent, so they are empty
+    stk_zeroTail(gStkSpan.numBlks);
+
+    if (stk_dbCrc() != gStkSpan.dbCrc) {
+        platformLog("Span failed: DB CRC 0x%04x expected 0x%04x\n", stk_dbCrc(), gStkSpan.dbCrc);
+        stk_spanAbort();
+        return false;
+    }
+
+    // Closed first, stk_commitRamFlash() refuses while it is open
+    memset((uint8_t *)&gStkSpan, 0, sizeof(gStkSpan));
+    stk_commitRamFlash();
+    stk_dbIndexInit();
+
+    return true;
+}
+//------------------------------------------------
+//            end SPANNED PAYLOADS
+//------------------------------------------------
+
+
+//------------------------------------------------
+//              RECENT-TAP CACHE
+//------------------------------------------------
+
+void stk_tapCacheFlush(void)
+{
+    memset((uint8_t *)gStkTapCache, 0, sizeof(gStkTapCache));
+}
+
+// Returns true on a hit, with the cached slot (-1 = not allowed) in *slot
+static bool stk_tapCacheLookup(uint64_t uid, bool truST25, int *slot)
+{
+    int i = 0;
+    uint32_t lnow = stk_rtcGetSeconds();
+
+    for (i = 0; i < STK_TAP_CACHE_ENTRIES; i++) {
+        stk_tap_cache_ent *lent = &gStkTapCache[i];
+        if ( (lent->uid == uid) &&
+             (lent->truST25 == truST25) &&
+             ((uint32_t)(lnow - lent->time) < STK_TAP_CACHE_TTL_SEC) )
+        {
+            *slot = lent->slot;
+            gStkTapCacheHits++;
+            return true;
+        }
+    }
+
+    gStkTapCacheMisses++;
+    return false;
+}
+
+static void stk_tapCacheStore(uint64_t uid, bool truST25, int slot)
+{
+    int i = 0;
+
+    // Drop any older entry for this UID, otherwise the least recent one
+    for (i = 0; i < (STK_TAP_CACHE_ENTRIES - 1); i++) {
+        if (gStkTapCache[i].uid == uid) {
+            break;
+        }
+    }
+    memmove(&gStkTapCache[1], &gStkTapCache[0], i * sizeof(gStkTapCache[0]));
+
+    gStkTapCache[0].uid     = uid;
+    gStkTapCache[0].time    = stk_rtcGetSeconds();
+    gStkTapCache[0].slot    = (int16_t)slot;
+    gStkTapCache[0].truST25 = truST25;
+}
+
+static bool stk_truST25CacheHit(uint64_t uid)
+{
+    int i = 0;
+    uint32_t lnow = stk_rtcGetSeconds();
+
+    for (i = 0; i < STK_TRUST25_CACHE_ENTRIES; i++) {
+        if ( (gStkTruST25Cache[i].uid == uid) &&
+             ((uint32_t)(lnow - gStkTruST25Cache[i].time) < STK_TRUST25_CACHE_TTL_SEC) )
+        {
+            gStkTruST25CacheHits++;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void stk_truST25CacheStore(uint64_t uid)
+{
+    int i = 0;
+    int loldest = 0;
+    uint32_t lnow = stk_rtcGetSeconds();
+
+    // Refresh this UID's entry, or replace the oldest one
+    for (i = 0; i < STK_TRUST25_CACHE_ENTRIES; i++) {
+        if (gStkTruST25Cache[i].uid == uid) {
+            loldest = i;
+            break;
+        }
+        if ((lnow - gStkTruST25Cache[i].time) > (lnow - gStkTruST25Cache[loldest].time)) {
+            loldest = i;
+        }
+    }
+
+    gStkTruST25Cache[loldest].uid  = uid;
+    gStkTruST25Cache[loldest].time = lnow;
+}
+//------------------------------------------------
+//            end RECENT-TAP CACHE
+//------------------------------------------------
+
+
+//------------------------------------------------
+//                  UID INDEX
+//------------------------------------------------
+
+// The UID of the sticker in the field as an index key.  It goes through
+// stk_nfcDev_or_backupStk() (as a plain sticker, no backup data) so it is
+// exactly the stk_dbEntry.uid that stk_addSticker() enrolled.
+static uint64_t stk_nfcDevUid(rfalNfcDevice *nfcDev)
+{
+    stk_data ldat;
+
+    memset((uint8_t *)&ldat, 0, sizeof(stk_data)); // STKFUNC_UNDEFINED: not a backup sticker
+    return stk_nfcDev_or_backupStk(nfcDev, &ldat);
+}
+
+// Position of the first index entry whose UID is >= uid
+static int stk_idxLowerBound(uint64_t uid)
+{
+    int lo = 0;
+    int hi = gStkUidIdxCnt;
+
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (gStkDbUids[gStkUidIdx[mid]] < uid) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
+
+// Returns the slot holding uid, or -1 if it is not in the DB
+static int stk_idxFind(uint64_t uid)
+{
+    int pos = stk_idxLowerBound(uid);
+
+    if ( (uid != 0) &&
+         (pos < gStkUidIdxCnt) &&
+         (gStkDbUids[gStkUidIdx[pos]] == uid) )
+    {
+        return gStkUidIdx[pos];
+    }
+
+    return -1;
+}
+
+// Refresh the gStkDbUids[]/gStkDbMeta[] mirror of one slot.  Call after
+// gStkRamFlash.entries[slot] has been written.
+static void stk_dbLoadSlot(int slot)
+{
+    gStkDbUids[slot] = gStkRamFlash.entries[slot].uid;
+    gStkDbMeta[slot] = gStkRamFlash.entries[slot].meta1_truST25_mast;
+}
+
+// Call after gStkRamFlash.entries[slot] has been written and mirrored
+static void stk_idxInsert(int slot)
+{
+    int pos = stk_idxLowerBound(gStkDbUids[slot]);
+
+    memmove(&gStkUidIdx[pos + 1], &gStkUidIdx[pos],
+            (gStkUidIdxCnt - pos) * sizeof(gStkUidIdx[0]));
+    gStkUidIdx[pos] = (uint16_t)slot;
+    gStkUidIdxCnt++;
+}
+
+// Call before gStkRamFlash.entries[gStkUidIdx[pos]] is cleared
+static void stk_idxRemove(int pos)
+{
+    gStkUidIdxCnt--;
+    memmove(&gStkUidIdx[pos], &gStkUidIdx[pos + 1],
+            (gStkUidIdxCnt - pos) * sizeof(gStkUidIdx[0]));
+}
+
+#define STK_OCC_BIT(slot)  (0x80000000UL >> ((slot) % 32))
+
+static void stk_occSet(int slot)
+{
+    gStkOccupied[slot / 32] |= STK_OCC_BIT(slot);
+}
+
+static void stk_occClear(int slot)
+{
+    gStkOccupied[slot / 32] &= ~STK_OCC_BIT(slot);
+}
+
+static bool stk_occIsSet(int slot)
+{
+    return (gStkOccupied[slot / 32] & STK_OCC_BIT(slot)) != 0;
+}
+
+// Returns the first free slot, or -1 if the DB is full
+static int stk_occFindFree(void)
+{
+    int w = 0;
+
+    for (w = 0; w < STK_OCC_WORDS; w++) {
+        uint32_t lfree = ~gStkOccupied[w];
+        if (lfree != 0) {
+            return (w * 32) + __builtin_clz(lfree);
+        }
+    }
+
+    return -1;
+}
+
+// Double hashing: bit j is (h1 + j*h2), with h1/h2 the two halves of a
+// 64-bit mix of the UID.
+static uint64_t stk_bloomHash(uint64_t uid)
+{
+    uid ^= uid >> 33;
+    uid *= 0xFF51AFD7ED558CCDULL;
+    uid ^= uid >> 33;
+    uid *= 0xC4CEB9FE1A85EC53ULL;
+    uid ^= uid >> 33;
+    return uid;
+}
+
+static void stk_bloomAdd(uint64_t uid)
+{
+    int j = 0;
+    uint64_t h  = stk_bloomHash(uid);
+    uint32_t h1 = (uint32_t)h;
+    uint32_t h2 = (uint32_t)(h >> 32) | 1U;
+
+    for (j = 0; j < STK_BLOOM_HASHES; j++) {
+        uint32_t bit = (h1 + (j * h2)) & (STK_BLOOM_BITS - 1);
+        gStkBloom[bit / 8] |= (uint8_t)(1U << (bit % 8));
+    }
+}
+
+// false means uid is definitely not in the DB
+static bool stk_bloomMayContain(uint64_t uid)
+{
+    int j = 0;
+    uint64_t h  = stk_bloomHash(uid);
+    uint32_t h1 = (uint32_t)h;
+    uint32_t h2 = (uint32_t)(h >> 32) | 1U;
+
+    for (j = 0; j < STK_BLOOM_HASHES; j++) {
+        uint32_t bit = (h1 + (j * h2)) & (STK_BLOOM_BITS - 1);
+        if ((gStkBloom[bit / 8] & (1U << (bit % 8))) == 0) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void stk_bloomRebuild(void)
+{
+    int i = 0;
+
+    memset(gStkBloom, 0, sizeof(gStkBloom));
+    for (i = 0; i < gStkUidIdxCnt; i++) {
+        stk_bloomAdd(gStkDbUids[gStkUidIdx[i]]);
+    }
+}
+
+//
+// Start an incremental rebuild of the UID index from gStkRamFlash.
+//
+// Call at boot once gStkRamFlash has been loaded from flash, then call
+// stk_dbIndexStep() from the idle loop until it returns true.  Taps are
+// served (more slowly) in the meantime, so the lock doesn't wait for the
+// index before the first unlock.
+//
+void stk_dbIndexBegin(void)
+{
+    int i = 0;
+
+    gStkIdxReady     = false;
+    gStkIdxBuildSlot = 0;
+    gStkUidIdxCnt    = 0;
+    gStkPageStale    = (uint16_t)((1U << STK_NUM_PAGES) - 1);
+    memset(gStkBloom, 0, sizeof(gStkBloom));
+    memset(gStkOccupied, 0, sizeof(gStkOccupied));
+    for (i = STK_ONFLASH_ENTRIES; i < (STK_OCC_WORDS * 32); i++) {
+        stk_occSet(i);
+    }
+    stk_tapCacheFlush();
+}
+
+//
+// Add up to maxSlots more slots to the index.  Returns true once the index
+// is complete (gStkIdxReady).
+//
+bool stk_dbIndexStep(uint16_t maxSlots)
+{
+    while ( (maxSlots > 0) && (gStkIdxBuildSlot < STK_ONFLASH_ENTRIES) ) {
+        int i = gStkIdxBuildSlot++;
+
+        stk_dbLoadSlot(i);
+        if (gStkDbUids[i] != 0) {
+            stk_occSet(i);
+            stk_idxInsert(i);
+            stk_bloomAdd(gStkDbUids[i]);
+        }
+        maxSlots--;
+    }
+
+    if ( !gStkIdxReady && (gStkIdxBuildSlot == STK_ONFLASH_ENTRIES) ) {
+        gStkIdxReady = true;
+        platformLog("UID index: %d entries\n", gStkUidIdxCnt);
+    }
+
+    return gStkIdxReady;
+}
+
+// Finish an index build that is still in progress
+static void stk_dbIndexEnsure(void)
+{
+    if (!gStkIdxReady) {
+        stk_dbIndexStep(STK_ONFLASH_ENTRIES);
+    }
+}
+
+//
+// Rebuild the UID index from gStkRamFlash in one go.
+//
+// Call after anything that rewrites gStkRamFlash.entries[] in bulk (paste
+// config, config payload, factory reset).  At boot use stk_dbIndexBegin().
+//
+void stk_dbIndexInit(void)
+{
+    stk_dbIndexBegin();
+    stk_dbIndexStep(STK_ONFLASH_ENTRIES);
+}
+
+//
+// Cross-check the SoA mirror, occupancy bitmap and UID index against
+// gStkRamFlash.
+//
+// Call at boot after stk_dbIndexInit() and after anything that may have
+// written entries[] behind the index's back.  If it fails, the caller
+// should call stk_dbIndexInit() again.  Skipped (true) while a spanned
+// payload is open: the index is meant to describe the committed DB then.
+//
+bool stk_dbIndexVerify(void)
+{
+    int i = 0;
+    int lnumUsed = 0;
+
+    if (stk_spanIsOpen()) {
+        return true;
+    }
+
+    for (i = 0; i < STK_ONFLASH_ENTRIES; i++) {
+        bool lused = (gStkRamFlash.entries[i].uid != 0);
+        if ( (gStkDbUids[i] != gStkRamFlash.entries[i].uid) ||
+             (gStkDbMeta[i] != gStkRamFlash.entries[i].meta1_truST25_mast) )
+        {
+            platformLog("Mirror mismatch in slot [%d]\n", i);
+            return false;
+        }
+        if (lused != stk_occIsSet(i)) {
+            platformLog("Occupancy mismatch in slot [%d]\n", i);
+            return false;
+        }
+        if (lused) {
+            lnumUsed++;
+        }
+    }
+
+    if (lnumUsed != gStkUidIdxCnt) {
+        platformLog("UID index has %d entries, flash has %d\n", gStkUidIdxCnt, lnumUsed);
+        return false;
+    }
+
+    for (i = 1; i < gStkUidIdxCnt; i++) {
+        if (gStkDbUids[gStkUidIdx[i - 1]] >
+            gStkDbUids[gStkUidIdx[i]])
+        {
+            platformLog("UID index out of order at [%d]\n", i);
+            return false;
+        }
+    }
+
+    return true;
+}
+//------------------------------------------------
+//                end UID INDEX
+//------------------------------------------------
+
+
+//
+// isTheSame() for a slot.  It reads the slot from gSRF, which holds the new
+// DB's member there while a spanned payload is open, so the committed member
+// is put back for the call.
+//
+static bool stk_slotIsTheSame(rfalNfcDevice *nfcDev, bool truST25, int slot)
+{
+    int lmember = IDX_uids + slot;
+    stk_dbEntry lnew;
+    bool lsame = false;
+
+    if ( !stk_spanIsOpen() || !stk_memberIsDirty(lmember) ) {
+        return isTheSame(nfcDev, truST25, IDX_uids, slot);
+    }
+
+    lnew = gSRF[lmember];
+    if (stk_eepromReadMember(lmember, &gSRF[lmember])) {
+        lsame = isTheSame(nfcDev, truST25, IDX_uids, slot);
+    }
+    gSRF[lmember] = lnew;
+
+    return lsame;
+}
+
+// stk_isInDB() for one slot already known to hold luid
+static bool stk_isInDBSlot(rfalNfcDevice *nfcDev, bool truST25, uint64_t luid,
+                           int slot, uint8_t meta)
+{
+    bool lisTruST25 = truST25 && ((meta & STK_ENTRY_META1_ISTRUST25) != 0);
+
+    // A recently verified TruST25 sticker only needs the UID match
+    if (lisTruST25 && stk_truST25CacheHit(luid)) {
+        platformLog("Found in slot [%d] (TruST25 cached)\n", slot);
+        return true;
+    }
+
+    if (lisTruST25) {
+        gStkTruST25Checks++;
+    }
+    if (stk_slotIsTheSame(nfcDev, truST25, slot)) {
+        if (lisTruST25) {
+            stk_truST25CacheStore(luid);
+        }
+        platformLog("Found in slot [%d]\n", slot);
+        return true;
+    }
+
+    return false;
+}
+
+//
+// This securely checks if a sticker is in the DB accounting
+// for the TruST25 validation rules.
+//
+static bool stk_isInDB(rfalNfcDevice *nfcDev, bool truST25)
+{
+    int i = 0;
+    int lslot = -1;
+    uint32_t t = stk_statStart();
+
+    gStkLastSlot = -1;
+
+    uint64_t luid = stk_nfcDevUid(nfcDev);
+    if (luid == 0) {
+        return false;
+    }
+
+    if (stk_tapCacheLookup(luid, truST25, &lslot)) {
+        gStkLastSlot = (int16_t)lslot;
+        stk_statStop(STK_STAGE_DB_LOOKUP, t);
+        return (lslot >= 0);
+    }
+
+    if (!gStkIdxReady) {
+        // Index still being built after boot: check every slot.  (Never
+        // while a span is open, entries[] is half written then.)
+        for (i = 0; i < STK_ONFLASH_ENTRIES; i++) {
+            if ( (gStkRamFlash.entries[i].uid == luid) &&
+                 stk_isInDBSlot(nfcDev, truST25, luid, i,
+                                gStkRamFlash.entries[i].meta1_truST25_mast) )
+            {
+                lslot = i;
+                break;
+            }
+        }
+    } else if (stk_bloomMayContain(luid)) {
+        // Only the slot(s) holding this UID need the full isTheSame() check
+        for (i = stk_idxLowerBound(luid); i < gStkUidIdxCnt; i++) {
+            int slot = gStkUidIdx[i];
+            if (gStkDbUids[slot] != luid) {
+                break;
+            }
+            if (stk_isInDBSlot(nfcDev, truST25, luid, slot, gStkDbMeta[slot])) {
+                lslot = slot;
+                break;
+            }
+        }
+    }
+
+    stk_tapCacheStore(luid, truST25, lslot);
+    gStkLastSlot = (int16_t)lslot;
+    stk_statStop(STK_STAGE_DB_LOOKUP, t);
+
+    return (lslot >= 0);
+}
+
+
+//
+// Backup Sticker is in DB
+//
+// This is not secure, it does not account for TruST25.  Only
+// use this if master has already been presented (i.e. in the
+// master state).  This only checks if a UID is in the DB.
+//
+static bool stk_bkupIsInDB(rfalNfcDevice *nfcDev, stk_data *dat)
+{
+    int slot = 0;
+
+    uint64_t luid = stk_nfcDev_or_backupStk(nfcDev, dat);
+    if (luid == 0) {
+        return false;
+    }
+
+    if (!gStkIdxReady) {
+        for (slot = 0; slot < STK_ONFLASH_ENTRIES; slot++) {
+            if (gStkRamFlash.entries[slot].uid == luid) {
+                platformLog("Found in slot [%d]\n", slot);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    if (!stk_bloomMayContain(luid)) {
+        return false;
+    }
+
+    slot = stk_idxFind(luid);
+    if (slot >= 0) {
+        platformLog("Found in slot [%d]\n", slot);
+        return true;
+    }
+
+    return false;
+}
+
+
+//
+// Add a UID to the DB.  Returns false if the DB is full or a spanned payload
+// is in progress.
+//
+static bool stk_dbAddUid(uint64_t luid, bool truST25, bool isMaster)
+{
+    int i = 0;
+
+    if (stk_spanIsOpen()) {
+        platformLog("DB busy: span in progress\n");
+        return false;
+    }
+
+    stk_dbIndexEnsure();
+    i = stk_idxFind(luid);
+
+    // See if its already in a slot
+    if (i >= 0) {
+        platformLog("Already in slot [%d]\n", i);
+        return true;
+    }
+
+    // Find a blank spot
+    i = stk_occFindFree();
+    if (i < 0) {
+        return false;
+    }
+
+    stk_writeToRamFlash_uid(luid, truST25, isMaster, IDX_uids, i);
+    stk_markDirty(IDX_uids, i);
+    stk_dbLoadSlot(i);
+    stk_occSet(i);
+    stk_idxInsert(i);
+    stk_bloomAdd(luid);
+    stk_tapCacheFlush();
+    platformLog("Added to slot [%d]\n", i);
+
+    return true;
+}
+
+
+//
+// Remove every slot holding a UID from the DB.  Returns false if it was not
+// in the DB or a spanned payload is in progress.
+//
+static bool stk_dbRemoveUid(uint64_t luid)
+{
+    int i = 0;
+    int pos = 0;
+    bool lfound = false;
+
+    stk_dbEntry lZeroEnt;
+    memset((uint8_t *)&lZeroEnt, 0, sizeof(stk_dbEntry));
+
+    if (stk_spanIsOpen()) {
+        platformLog("DB busy: span in progress\n");
+        return false;
+    }
+
+    stk_dbIndexEnsure();
+
+    // Duplicates sit next to each other in the index
+    for (pos = stk_idxLowerBound(luid); pos < gStkUidIdxCnt; ) {
+        i = gStkUidIdx[pos];
+        if (gStkDbUids[i] != luid) {
+            break;
+        }
+
+        // Write all 0's to the slot
+        stk_idxRemove(pos);
+        stk_writeToRamFlash_ent(&lZeroEnt, IDX_uids, i);
+        stk_markDirty(IDX_uids, i);
+        stk_dbLoadSlot(i);
+        stk_occClear(i);
+        platformLog("Removed from slot [%d]\n", i);
+        lfound = true;
+    }
+
+    if (lfound) {
+        stk_bloomRebuild();
+        stk_tapCacheFlush();
+    }
+
+    return lfound;
+}
+
+
+static bool stk_addSticker(rfalNfcDevice *nfcDev, bool truST25, stk_data *dat)
+{
+    assert_param(nfcDev != NULL);
+    assert_param(dat    != NULL);
+
+    bool lisAMaster = false; // Local, is a master
+
+    uint64_t luid = stk_nfcDev_or_backupStk(nfcDev, dat);
+    if (luid == 0) {
+        return false;
+    }
+
+    // Already verified in stk_isValidSticker()
+    if (dat->always.function == STKFUNC_MASTER) {
+        lisAMaster = true;
+    }
+
+    // If its a backup sticker and the meta data says the associated user
+    // sticker should have TruST25, then mark it as such.
+    if ( (dat->always.function == STKFUNC_BACKUP_STICKER) &&
+         (dat->always.version > STK_ONSTICK_DATA_VERSION1) &&
+         (dat->payload.fmat.meta1_truST25 == 1) )
+    {
+        truST25 = true;
+    }
+
+    return stk_dbAddUid(luid, truST25, lisAMaster);
+}
+
+
+static bool stk_removeSticker(rfalNfcDevice *nfcDev, stk_data *dat)
+{
+    assert_param(nfcDev != NULL);
+    assert_param(dat    != NULL);
+
+    // AVOID_CONFUSION_DO_NOTHING
+    //
+    // We should be able to return an error from this function
+    // to indicate that we were not able to remove the sticker.
+    // Instead of flashing red (which is what we do when a remove
+    // is successful), lets instead not blink anything.
+    //
+    // This is to avoid confusion.  For example, if you blink some
+    // sort of red code to indicate error, that is confusing because
+    // the user is expecting to see red anyways since they are removing
+    // a sticker.
+
+    uint64_t luid = stk_nfcDev_or_backupStk(nfcDev, dat);
+    if (luid == 0) {
+        return false;
+    }
+
+    stk_dbRemoveUid(luid);
+
+    return true;
+}
+
+
+//------------------------------------------------
+//               MULTI-TAG FIELD
+//------------------------------------------------
+//
+// The normal poll hands us one rfalNfcDevice at a time, so with a phone or a
+// transit card next to the fob the lock can lock onto the wrong tag first
+// and lose a whole poll period.  Instead:
+//
+//     if (stk_fieldInventory() > 0) {
+//         int i = stk_fieldPick(truST25, &allowed);
+//         allowed -> unlock, gStkLastSlot
+//         else    -> handle gStkField[i] as usual (function sticker etc)
+//     }
+//
+// Only tags whose UID is in the index get the full stk_isInDB() check (and
+// its TruST25 RF traffic), the rest are rejected from RAM.  If none is
+// allowed, the prefetched stk_dat_always picks the tag: a function sticker
+// (master, add, config payload...) first, then any stickLabs sticker, and
+// only then a foreign tag (phone, transit card).
+//
+// Reads of the picked tag are addressed to its UID (see stk_nfcDevAddr()),
+// the unpicked tags stay in the ready state and would answer unaddressed
+// ones.  stk_readStickerData(&gStkField[i].dev, ...) starts from the
+// prefetched stk_dat_always.
+//
+
+//
+// Enumerate the ISO15693 tags in the field (one inventory round) and read
+// each one's stk_dat_always with an addressed Read Single Block.  Returns
+// the number of tags found.
+//
+uint8_t stk_fieldInventory(void)
+{
+    rfalNfcvListenDevice lnfcv[STK_FIELD_MAX_TAGS];
+    uint8_t  lrxBuf[NFCV_READ_BLOCK_LEN];
+    uint8_t  lcnt = 0;
+    uint8_t  i = 0;
+    uint32_t t = stk_statStart();
+
+    gStkFieldCnt = 0;
+
+    if ( (rfalNfcvPollerCollisionResolution(RFAL_COMPLIANCE_MODE_NFC, STK_FIELD_MAX_TAGS,
+                                            lnfcv, &lcnt) != ERR_NONE) ||
+         (lcnt > STK_FIELD_MAX_TAGS) )
+    {
+        lcnt = 0;
+    }
+    stk_statStop(STK_STAGE_ANTICOLL, t);
+
+    for (i = 0; i < lcnt; i++) {
+        stk_field_tag *ltag = &gStkField[i];
+        uint16_t rcvLen = 0;
+
+        memset((uint8_t *)ltag, 0, sizeof(stk_field_tag));
+        ltag->dev.type     = RFAL_NFC_LISTEN_TYPE_NFCV;
+        ltag->dev.dev.nfcv = lnfcv[i];
+        ltag->dev.nfcid    = ltag->dev.dev.nfcv.InvRes.UID;
+        ltag->dev.nfcidLen = RFAL_NFCV_UID_LEN;
+
+        // Addressed: the other tags stay quiet
+        if ( (rfalNfcvPollerReadSingleBlock(RFAL_NFCV_REQ_FLAG_DEFAULT, ltag->dev.nfcid,
+                                            STK_DATA_START_BLOCK, lrxBuf, sizeof(lrxBuf),
+                                            &rcvLen) == ERR_NONE) &&
+             (rcvLen == NFCV_READ_RET_LEN) )
+        {
+            memcpy((uint8_t *)&ltag->always, &lrxBuf[1], STK_DAT_ALWAYS_LEN);
+            ltag->alwaysOk = true;
+        }
+    }
+
+    gStkFieldCnt = lcnt;
+    gStkFieldPolls[lcnt]++;
+    platformLog("Field: %d tag(s)\n", lcnt);
+
+    return lcnt;
+}
+
+//
+// A stickLabs sticker, judging by its prefetched stk_dat_always.  (The CRC
+// covers the payload of longer functions too, so stk_isValidSticker() checks
+// it once the picked tag has been read.)
+//
+static bool stk_fieldIsStk(const stk_field_tag *tag)
+{
+    return tag->alwaysOk &&
+           (tag->always.version >= STK_ONSTICK_DATA_VERSION1) &&
+           (tag->always.version <= STK_ONSTICK_DATA_VERSION2) &&
+           (tag->always.function != STKFUNC_UNDEFINED) &&
+           (stk_funcInfo(tag->always.function) != NULL);
+}
+
+//
+// Evaluate the tags from stk_fieldInventory() as a batch and return the
+// index (into gStkField) of the one to handle, -1 if the field is empty.
+// *allowed is true if it is in the DB (gStkLastSlot is its slot).
+//
+int stk_fieldPick(bool truST25, bool *allowed)
+{
+    bool    lcand[STK_FIELD_MAX_TAGS];
+    int     lpick = -1;
+    uint8_t i = 0;
+
+    assert_param(allowed != NULL);
+    *allowed = false;
+    gStkLastSlot = -1;
+
+    if (gStkFieldCnt == 0) {
+        return -1;
+    }
+
+    // Pass 1, RAM only: which UIDs are in the DB at all (everyone is a
+    // candidate while the index is still being built after boot)
+    for (i = 0; i < gStkFieldCnt; i++) {
+        uint64_t luid = stk_nfcDevUid(&gStkField[i].dev);
+        lcand[i] = (luid != 0) &&
+                   ( !gStkIdxReady ||
+                     (stk_bloomMayContain(luid) && (stk_idxFind(luid) >= 0)) );
+    }
+
+    // Pass 2: the full (TruST25) check, in inventory order
+    for (i = 0; (i < gStkFieldCnt) && (lpick < 0); i++) {
+        if (lcand[i] && stk_isInDB(&gStkField[i].dev, truST25)) {
+            *allowed = true;
+            lpick = i;
+        }
+    }
+
+    // Pass 3: nobody allowed, pick by what the tags are
+    for (i = 0; (i < gStkFieldCnt) && (lpick < 0); i++) {
+        if ( stk_fieldIsStk(&gStkField[i]) &&
+             (gStkField[i].always.function != STKFUNC_REGULAR) )
+        {
+            lpick = i;
+        }
+    }
+    for (i = 0; (i < gStkFieldCnt) && (lpick < 0); i++) {
+        if (stk_fieldIsStk(&gStkField[i])) {
+            lpick = i;
+        }
+    }
+    if (lpick < 0) {
+        lpick = 0;
+    }
+
+    return lpick;
+}
+//------------------------------------------------
+//             end MULTI-TAG FIELD
+//------------------------------------------------